@@ -0,0 +1,324 @@
+/** @file AnimSampler.h
+ * A reference CPU implementation of WOBJ animation: sampling animation tracks, evaluating the node tree into
+ * skinning matrices and skinning vertices, using SSE (and AVX if enabled) where available.
+ */
+
+#ifndef CORE_ANIMSAMPLER_H_INCLUDED
+#define CORE_ANIMSAMPLER_H_INCLUDED
+
+#include "common.h"
+#include "vec.h"
+#include "WOBJReader.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define ANIM_SAMPLER_SSE
+#include <xmmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/** A 4x4 matrix stored in column major order. Like aiMatrix4x4, it transforms column vectors, so the translation is
+ * the last column. It is aligned for SSE, but SSE code loads it unaligned, since containers such as std::vector do
+ * not have to honour the alignment before C++17. */
+struct alignas(16) Mat4 {
+	float m[16];
+	static inline Mat4 identity(){Mat4 r; for(int i=0; i<16; i++) r.m[i] = (i%5 == 0)?1.0f:0.0f; return r;}
+	/** Creates a matrix from 16 floats in row major order, the order WOBJ files and aiMatrix4x4 store them in. */
+	static inline Mat4 fromRows(const float* rows){Mat4 r; for(int c=0; c<4; c++) for(int i=0; i<4; i++) r.m[c*4+i] = rows[i*4+c]; return r;}
+	inline float3 transformPoint(const float3& p) const {
+		return float3::make(m[0]*p.x+m[4]*p.y+m[8]*p.z+m[12], m[1]*p.x+m[5]*p.y+m[9]*p.z+m[13], m[2]*p.x+m[6]*p.y+m[10]*p.z+m[14]);
+	}
+	inline float3 transformVector(const float3& v) const {
+		return float3::make(m[0]*v.x+m[4]*v.y+m[8]*v.z, m[1]*v.x+m[5]*v.y+m[9]*v.z, m[2]*v.x+m[6]*v.y+m[10]*v.z);
+	}
+};
+/** Returns the product a*b, which applies b and then a. */
+inline Mat4 mul(const Mat4& a, const Mat4& b){
+	Mat4 r;
+#ifdef ANIM_SAMPLER_SSE
+	__m128 c0 = _mm_loadu_ps(a.m), c1 = _mm_loadu_ps(a.m+4), c2 = _mm_loadu_ps(a.m+8), c3 = _mm_loadu_ps(a.m+12);
+	for(int i=0; i<4; i++){
+		const float* col = b.m+i*4;
+		__m128 v = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(col[0])), _mm_mul_ps(c1, _mm_set1_ps(col[1])));
+		v = _mm_add_ps(v, _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(col[2])), _mm_mul_ps(c3, _mm_set1_ps(col[3]))));
+		_mm_storeu_ps(r.m+i*4, v);
+	}
+#else
+	for(int i=0; i<4; i++) for(int j=0; j<4; j++)
+		r.m[i*4+j] = a.m[j]*b.m[i*4]+a.m[4+j]*b.m[i*4+1]+a.m[8+j]*b.m[i*4+2]+a.m[12+j]*b.m[i*4+3];
+#endif
+	return r;
+}
+/** Returns the transpose of a matrix, which is its inverse if it is a rotation. */
+inline Mat4 transpose(const Mat4& a){Mat4 r; for(int c=0; c<4; c++) for(int i=0; i<4; i++) r.m[c*4+i] = a.m[i*4+c]; return r;}
+
+/** The axis swap CreateWOBJ applies to the root node, converting assimp's y up coordinates to z up. The root node's
+ * transform in a WOBJ file is this matrix times the root's own transform. */
+const float WOBJ_AXIS_SWAP[16] = {1,0,0,0, 0,0,-1,0, 0,1,0,0, 0,0,0,1};
+
+/** Quaternions are stored in a float4 as (x, y, z, w). */
+inline float4 quatMul(const float4& a, const float4& b){
+	return float4::make(a.w*b.x+a.x*b.w+a.y*b.z-a.z*b.y, a.w*b.y-a.x*b.z+a.y*b.w+a.z*b.x,
+		a.w*b.z+a.x*b.y-a.y*b.x+a.z*b.w, a.w*b.w-a.x*b.x-a.y*b.y-a.z*b.z);
+}
+inline float4 quatConj(const float4& q){return float4::make(-q.x, -q.y, -q.z, q.w);}
+/** Rotates a vector by a unit quaternion. */
+inline float3 quatRotate(const float4& q, const float3& v){
+	float4 r = quatMul(quatMul(q, float4::make(v.x, v.y, v.z, 0)), quatConj(q)); return float3::make(r.x, r.y, r.z);
+}
+/** Spherically interpolates between two rotations along the shortest path, the same way assimp does. */
+inline float4 slerp(const float4& a, const float4& b, float t){
+	float cosom = a.x*b.x+a.y*b.y+a.z*b.z+a.w*b.w; float4 end = b;
+	if(cosom < 0){cosom = -cosom; end = -end;}
+	float sclp, sclq;
+	if(1-cosom > 0.0001f){
+		float omega = acos(cosom), sinom = sin(omega);
+		sclp = sin((1-t)*omega)/sinom; sclq = sin(t*omega)/sinom;
+	} else {sclp = 1-t; sclq = t;}
+	return a*sclp+end*sclq;
+}
+/** Returns the matrix that scales by s, then rotates by the unit quaternion q, then translates by t. */
+inline Mat4 composeTRS(const float3& t, const float4& q, const float3& s){
+	Mat4 r; float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z, xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z, wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+	r.m[0] = (1-2*(yy+zz))*s.x; r.m[1] = 2*(xy+wz)*s.x; r.m[2] = 2*(xz-wy)*s.x; r.m[3] = 0;
+	r.m[4] = 2*(xy-wz)*s.y; r.m[5] = (1-2*(xx+zz))*s.y; r.m[6] = 2*(yz+wx)*s.y; r.m[7] = 0;
+	r.m[8] = 2*(xz+wy)*s.z; r.m[9] = 2*(yz-wx)*s.z; r.m[10] = (1-2*(xx+yy))*s.z; r.m[11] = 0;
+	r.m[12] = t.x; r.m[13] = t.y; r.m[14] = t.z; r.m[15] = 1; return r;
+}
+/** Splits an affine matrix with no shear into a translation, a unit quaternion rotation and a scale. */
+inline void decomposeTRS(const Mat4& a, float3& t, float4& q, float3& s){
+	t = float3::make(a.m[12], a.m[13], a.m[14]);
+	float3 c0 = float3::make(a.m[0], a.m[1], a.m[2]), c1 = float3::make(a.m[4], a.m[5], a.m[6]), c2 = float3::make(a.m[8], a.m[9], a.m[10]);
+	s = float3::make((float)length(c0), (float)length(c1), (float)length(c2));
+	if(dot(cross(c0, c1), c2) < 0) s.x = -s.x;
+	if(s.x != 0) c0 /= s.x; if(s.y != 0) c1 /= s.y; if(s.z != 0) c2 /= s.z;
+	float trace = c0.x+c1.y+c2.z;
+	if(trace > 0){float k = 0.5f/sqrt(trace+1); q = float4::make((c1.z-c2.y)*k, (c2.x-c0.z)*k, (c0.y-c1.x)*k, 0.25f/k);}
+	else if(c0.x > c1.y && c0.x > c2.z){float k = 2*sqrt(1+c0.x-c1.y-c2.z); q = float4::make(0.25f*k, (c1.x+c0.y)/k, (c2.x+c0.z)/k, (c1.z-c2.y)/k);}
+	else if(c1.y > c2.z){float k = 2*sqrt(1+c1.y-c0.x-c2.z); q = float4::make((c1.x+c0.y)/k, 0.25f*k, (c2.y+c1.z)/k, (c2.x-c0.z)/k);}
+	else {float k = 2*sqrt(1+c2.z-c0.x-c1.y); q = float4::make((c2.x+c0.z)/k, (c2.y+c1.z)/k, 0.25f*k, (c0.y-c1.x)/k);}
+}
+
+/** A rigid transform stored as a unit dual quaternion, with a uniform scale applied before it. Blending dual
+ * quaternions keeps the volume that blending matrices loses around joints, and a dual quaternion takes 32 bytes
+ * (36 with the scale) where a matrix takes 48 or 64. */
+struct DualQuat {
+	float4 real, dual; float scale;
+	/** Creates a dual quaternion that scales by s, then rotates by the unit quaternion q, then translates by t. */
+	static inline DualQuat make(const float4& q, const float3& t, float s){
+		DualQuat d; d.real = q; d.dual = quatMul(float4::make(t.x, t.y, t.z, 0), q)*0.5f; d.scale = s; return d;
+	}
+	static inline DualQuat identity(){return make(float4::make(0, 0, 0, 1), float3::make(0, 0, 0), 1);}
+	/** Creates a dual quaternion from a matrix with no shear. Dual quaternions cannot hold non-uniform scales,
+	 * so the average of the matrix's scales is used. */
+	static inline DualQuat fromMatrix(const Mat4& m){float3 t, s; float4 q; decomposeTRS(m, t, q, s); return make(q, t, (s.x+s.y+s.z)/3);}
+	inline float3 getTranslation() const {float4 t = quatMul(dual, quatConj(real))*2.0f; return float3::make(t.x, t.y, t.z);}
+	inline float3 transformPoint(const float3& p) const {return quatRotate(real, p*scale)+getTranslation();}
+	inline float3 transformVector(const float3& v) const {return quatRotate(real, v);}
+};
+/** Returns the transform that applies b and then a. */
+inline DualQuat mul(const DualQuat& a, const DualQuat& b){
+	return DualQuat::make(quatMul(a.real, b.real), a.transformPoint(b.getTranslation()), a.scale*b.scale);
+}
+/** The tag of the section holding dual quaternion inverse bind poses, written by CreateWOBJ with -dualquat.
+ * It holds the bone count (int), then for each bone its rotation (x, y, z, w), dual part (x, y, z, w) and scale. */
+const int WOBJ_DUAL_QUAT_SECTION = FOURCC('D','Q','B','P');
+/** Reads the dual quaternion inverse bind poses of a file. Returns false if the file has none. */
+inline bool readDualQuatBinds(const WOBJFile& file, std::vector<DualQuat>& binds){
+	const WOBJSection* section = file.findSection(WOBJ_DUAL_QUAT_SECTION); if(section == NULL) return false;
+	WOBJInput in(section->data, section->size); int n = in.readInt();
+	if(n < 0 || (ulonglong)n > in.remaining()/36) return false;
+	binds.resize(n); for(int i=0; i<n; i++){
+		DualQuat& d = binds[i]; for(int j=0; j<4; j++) d.real[j] = in.readFloat();
+		for(int j=0; j<4; j++) d.dual[j] = in.readFloat(); d.scale = in.readFloat();
+	} return in.good();
+}
+
+/** The tag of the section listing additive animations, written by CreateWOBJ with -additive. It holds the number
+ * of additive animations (int), then for each its index and the index of the animation whose first frame its
+ * deltas are relative to, or -1 if they are relative to the bind pose (ints). */
+const int WOBJ_ADDITIVE_SECTION = FOURCC('A','D','D','V');
+
+/** Returns the key of a track that time falls after: the last key whose time is at most time, or 0 if time is
+ * before the first key. Keys are stride floats each, starting with their time. */
+inline int findKey(const float* keys, int count, int stride, float time){
+	int lo = 0, hi = count-1;
+	while(lo < hi){int mid = (lo+hi+1)/2; if(keys[mid*stride] <= time) lo = mid; else hi = mid-1;}
+	return lo;
+}
+/** Samples a (time, x, y, z) track, interpolating linearly and clamping to its first and last keys.
+ * Returns def if the track has no keys. */
+inline float3 sampleVector(const std::vector<float>& track, float time, const float3& def){
+	int count = (int)track.size()/4; if(count == 0) return def;
+	const float* keys = &track[0]; int i = findKey(keys, count, 4, time); const float* k = keys+i*4;
+	if(i == count-1 || time <= k[0]) return float3::make(k[1], k[2], k[3]);
+	float f = (time-k[0])/(k[4]-k[0]); return interp(float3::make(k[1], k[2], k[3]), float3::make(k[5], k[6], k[7]), f);
+}
+/** Samples a (time, w, x, y, z) rotation track, interpolating spherically and clamping to its first and last keys.
+ * Returns def if the track has no keys. */
+inline float4 sampleQuat(const std::vector<float>& track, float time, const float4& def){
+	int count = (int)track.size()/5; if(count == 0) return def;
+	const float* keys = &track[0]; int i = findKey(keys, count, 5, time); const float* k = keys+i*5;
+	if(i == count-1 || time <= k[0]) return float4::make(k[2], k[3], k[4], k[1]);
+	float f = (time-k[0])/(k[5]-k[0]); return slerp(float4::make(k[2], k[3], k[4], k[1]), float4::make(k[7], k[8], k[9], k[6]), f);
+}
+
+/** Evaluates the animations of a WOBJ file. Each frame, reset() (or sample() over every animated node) sets the
+ * local transforms, evaluate() computes the global transform of each node in the file's flat node order, and
+ * getPalette() produces the skinning matrix of each bone. The file must outlive the sampler.
+ */
+class AnimSampler {
+	const WOBJFile* file; std::vector<int> parents, boneNodes; std::vector<Mat4> bind, local, global, inverseBinds;
+	std::vector<float3> bindT, bindS; std::vector<float4> bindR; std::vector<DualQuat> dualQuatBinds; Mat4 axisSwap;
+public:
+	explicit AnimSampler(const WOBJFile& f) : file(&f), axisSwap(Mat4::fromRows(WOBJ_AXIS_SWAP)){
+		int n = (int)f.nodes.size(), nBones = 0; parents.assign(n, -1);
+		for(int i=0; i<n; i++){
+			const WOBJNode& node = f.nodes[i]; for(int c=0; c<node.numChildren; c++) parents[node.firstChild+c] = i;
+			bind.push_back(Mat4::fromRows(node.transform)); if(node.bone+1 > nBones) nBones = node.bone+1;
+			float3 t, s; float4 q; decomposeTRS(i == 0?mul(transpose(axisSwap), bind[i]):bind[i], t, q, s);
+			bindT.push_back(t); bindR.push_back(q); bindS.push_back(s);
+		} boneNodes.assign(nBones, -1); inverseBinds.assign(nBones, Mat4::identity());
+		for(int i=0; i<n; i++) if(f.nodes[i].bone >= 0){boneNodes[f.nodes[i].bone] = i; inverseBinds[f.nodes[i].bone] = Mat4::fromRows(f.nodes[i].inverseBind);}
+		if(!readDualQuatBinds(f, dualQuatBinds) || (int)dualQuatBinds.size() != nBones){
+			dualQuatBinds.resize(nBones); for(int b=0; b<nBones; b++) dualQuatBinds[b] = DualQuat::fromMatrix(inverseBinds[b]);
+		} local = bind; global = bind;
+	}
+	/** Resets every node to its bind transform. */
+	inline void reset(){local = bind;}
+	/** Samples an animation at a time in its ticks, setting the local transform of every node it animates. Other
+	 * nodes keep their current transform, so reset() should be called first unless animations are being layered.
+	 * Tracks with no keys keep the bind pose's value. */
+	void sample(int anim, float time){
+		const WOBJAnimation& a = file->animations[anim];
+		for(size_t c=0; c<a.channels.size(); c++){
+			const WOBJChannel& ch = a.channels[c]; int n = ch.node;
+			Mat4 m = composeTRS(sampleVector(ch.position, time, bindT[n]), sampleQuat(ch.rotation, time, bindR[n]), sampleVector(ch.scale, time, bindS[n]));
+			local[n] = (n == 0)?mul(axisSwap, m):m;
+		}
+	}
+	/** Layers an additive animation (written by CreateWOBJ with -additive) over the current local transforms,
+	 * scaled by weight: position deltas are added, rotation deltas are applied after the current rotation, and
+	 * scale factors multiply the current scale. Tracks with no keys leave their part of the transform unchanged. */
+	void sampleAdditive(int anim, float time, float weight = 1){
+		const WOBJAnimation& a = file->animations[anim]; float4 identity = float4::make(0, 0, 0, 1);
+		for(size_t c=0; c<a.channels.size(); c++){
+			const WOBJChannel& ch = a.channels[c]; int n = ch.node; float3 t, s; float4 q;
+			decomposeTRS(n == 0?mul(transpose(axisSwap), local[n]):local[n], t, q, s);
+			float3 dt = sampleVector(ch.position, time, float3::make(0, 0, 0)), ds = interp(float3::make(1, 1, 1), sampleVector(ch.scale, time, float3::make(1, 1, 1)), weight);
+			float4 dq = slerp(identity, sampleQuat(ch.rotation, time, identity), weight);
+			Mat4 m = composeTRS(t+dt*weight, quatMul(q, dq), float3::make(s.x*ds.x, s.y*ds.y, s.z*ds.z));
+			local[n] = (n == 0)?mul(axisSwap, m):m;
+		}
+	}
+	/** Computes the global transform of every node from the local transforms. Parents always come before their
+	 * children in the node order, so this is a single pass. */
+	void evaluate(){
+		for(size_t i=0; i<local.size(); i++) global[i] = (parents[i] < 0)?local[i]:mul(global[parents[i]], local[i]);
+	}
+	/** Writes the skinning matrix of every bone, its node's global transform times its inverse bind pose, to
+	 * palette, which must hold getBoneCount() matrices. Bones with no node are set to the identity. */
+	void getPalette(Mat4* palette) const {
+		for(size_t b=0; b<boneNodes.size(); b++) palette[b] = (boneNodes[b] < 0)?Mat4::identity():mul(global[boneNodes[b]], inverseBinds[b]);
+	}
+	/** Writes the skinning transform of every bone as a dual quaternion to palette, which must hold getBoneCount()
+	 * dual quaternions. Inverse bind poses come from the file's dual quaternion section if it has one, and are
+	 * converted from its matrices otherwise. Node transforms are converted to dual quaternions, so scales are
+	 * only exact if they are uniform. */
+	void getDualQuatPalette(DualQuat* palette) const {
+		for(size_t b=0; b<boneNodes.size(); b++)
+			palette[b] = (boneNodes[b] < 0)?DualQuat::identity():mul(DualQuat::fromMatrix(global[boneNodes[b]]), dualQuatBinds[b]);
+	}
+	inline int getBoneCount() const {return (int)boneNodes.size();}
+	inline int getNodeCount() const {return (int)local.size();}
+	inline const Mat4& getGlobal(int node) const {return global[node];}
+	inline const Mat4& getLocal(int node) const {return local[node];}
+	inline void setLocal(int node, const Mat4& m){local[node] = m;}
+	/** Returns the node a bone is attached to, or -1 if it has none. */
+	inline int getBoneNode(int bone) const {return boneNodes[bone];}
+	inline const Mat4& getInverseBind(int bone) const {return inverseBinds[bone];}
+	/** Returns the bind pose translation, rotation and scale of a node, without the axis swap for the root. */
+	inline const float3& getBindTranslation(int node) const {return bindT[node];}
+	inline const float4& getBindRotation(int node) const {return bindR[node];}
+	inline const float3& getBindScale(int node) const {return bindS[node];}
+};
+
+/** Returns the bone index stored in a vertex as a float, or -1 if it is not an index into a palette of count
+ * bones. The range is checked before converting, since converting NaN or huge floats to int is undefined. */
+inline int getBoneIndex(float index, int count){return (index >= 0 && index < count)?(int)index:-1;}
+/** Returns true if a file's vertices have bone indices and weights (64 bytes each) and count vertices starting
+ * at first are within them. */
+inline bool canSkin(const WOBJFile& file, longlong first, longlong count){
+	return file.vertexStride >= 64 && first >= 0 && count >= 0 && count <= file.vertexCount && first <= file.vertexCount-count;
+}
+
+/** Skins vertices of a WOBJ file with a palette from AnimSampler::getPalette(). Each vertex blends the palette
+ * matrices of its four bone indices by its bone weights, and writes its skinned position and normal (6 floats)
+ * to out. Bone indices outside the palette are ignored. Normals are transformed by the blended matrix and
+ * renormalized, like a typical vertex shader, so they are only exact for uniform scales.
+ * Returns false, skinning nothing, if the file has no bone indices and weights (static files) or the range is
+ * not within its vertices.
+ * @param first The first vertex to skin. @param count The number of vertices to skin. */
+inline bool skinVertices(const WOBJFile& file, const Mat4* palette, int paletteSize, longlong first, longlong count, float* out){
+	if(!canSkin(file, first, count)) return false;
+	for(longlong v=0; v<count; v++, out+=6){
+		float vert[16]; memcpy(vert, file.getVertex(first+v), 64);
+#if defined(__AVX__)
+		__m256 c01 = _mm256_setzero_ps(), c23 = _mm256_setzero_ps();
+		for(int j=0; j<4; j++){
+			int b = getBoneIndex(vert[8+j], paletteSize); if(vert[12+j] == 0 || b < 0) continue;
+			__m256 w = _mm256_set1_ps(vert[12+j]); const float* m = palette[b].m;
+			c01 = _mm256_add_ps(c01, _mm256_mul_ps(w, _mm256_loadu_ps(m))); c23 = _mm256_add_ps(c23, _mm256_mul_ps(w, _mm256_loadu_ps(m+8)));
+		} __m128 c0 = _mm256_castps256_ps128(c01), c1 = _mm256_extractf128_ps(c01, 1), c2 = _mm256_castps256_ps128(c23), c3 = _mm256_extractf128_ps(c23, 1);
+#elif defined(ANIM_SAMPLER_SSE)
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for(int j=0; j<4; j++){
+			int b = getBoneIndex(vert[8+j], paletteSize); if(vert[12+j] == 0 || b < 0) continue;
+			__m128 w = _mm_set1_ps(vert[12+j]); const float* m = palette[b].m;
+			c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(m))); c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(m+4)));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(m+8))); c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(m+12)));
+		}
+#endif
+#ifdef ANIM_SAMPLER_SSE
+		__m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vert[3])), _mm_mul_ps(c1, _mm_set1_ps(vert[4]))), _mm_mul_ps(c2, _mm_set1_ps(vert[5])));
+		__m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vert[0])), _mm_mul_ps(c1, _mm_set1_ps(vert[1]))), _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(vert[2])), c3));
+		float pr[4], nr[4]; _mm_storeu_ps(pr, p); _mm_storeu_ps(nr, n);
+		float3 pos = float3::make(pr[0], pr[1], pr[2]), norm = float3::make(nr[0], nr[1], nr[2]);
+#else
+		Mat4 m; memset(m.m, 0, sizeof(m.m));
+		for(int j=0; j<4; j++){
+			int b = getBoneIndex(vert[8+j], paletteSize); if(vert[12+j] == 0 || b < 0) continue;
+			for(int k=0; k<16; k++) m.m[k] += vert[12+j]*palette[b].m[k];
+		} float3 pos = m.transformPoint(float3::make(vert[0], vert[1], vert[2])), norm = m.transformVector(float3::make(vert[3], vert[4], vert[5]));
+#endif
+		double len = length(norm); if(len > 0) norm /= (float)len;
+		out[0] = pos.x; out[1] = pos.y; out[2] = pos.z; out[3] = norm.x; out[4] = norm.y; out[5] = norm.z;
+	} return true;
+}
+
+/** Skins vertices like skinVertices(), but with a dual quaternion palette from AnimSampler::getDualQuatPalette().
+ * The dual quaternions of each vertex's bones are blended linearly (flipping those on the opposite hemisphere
+ * from the first) and renormalized, and the scales are blended by the same weights. */
+inline bool skinVerticesDualQuat(const WOBJFile& file, const DualQuat* palette, int paletteSize, longlong first, longlong count, float* out){
+	if(!canSkin(file, first, count)) return false;
+	for(longlong v=0; v<count; v++, out+=6){
+		float vert[16]; memcpy(vert, file.getVertex(first+v), 64); DualQuat d; bool any = false;
+		d.real = float4::make(0, 0, 0, 0); d.dual = d.real; d.scale = 0;
+		for(int j=0; j<4; j++){
+			int b = getBoneIndex(vert[8+j], paletteSize); float w = vert[12+j]; if(w == 0 || b < 0) continue;
+			const DualQuat& p = palette[b]; d.scale += w*p.scale;
+			if(any && dot(p.real, d.real) < 0) w = -w;
+			d.real += p.real*w; d.dual += p.dual*w; any = true;
+		} float len = any?(float)length(d.real):0;
+		if(len > 0){d.real /= len; d.dual /= len;} else d = DualQuat::identity();
+		float3 pos = d.transformPoint(float3::make(vert[0], vert[1], vert[2])), norm = d.transformVector(float3::make(vert[3], vert[4], vert[5]));
+		out[0] = pos.x; out[1] = pos.y; out[2] = pos.z; out[3] = norm.x; out[4] = norm.y; out[5] = norm.z;
+	} return true;
+}
+
+#endif // CORE_ANIMSAMPLER_H_INCLUDED
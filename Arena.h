@@ -0,0 +1,72 @@
+/** @file Arena.h
+ * A monotonic arena for short-lived allocations, and an STL allocator that draws from it.
+ */
+
+#ifndef CORE_ARENA_H_INCLUDED
+#define CORE_ARENA_H_INCLUDED
+
+#include "common.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+/** A monotonic arena. Allocations are carved sequentially out of large blocks and are never freed individually;
+ * instead the whole arena is reset at once. Reset keeps the blocks, so repeated jobs of a similar size stop
+ * touching the system allocator after the first one.
+ */
+class Arena {
+	struct Block {char* data; size_t size;};
+	std::vector<Block> blocks; size_t current, used, blockSize;
+	Arena(const Arena&); Arena& operator=(const Arena&);
+public:
+	/** Creates an empty arena that allocates blocks of at least the passed size. */
+	inline Arena(size_t block = 1 << 16) : current(0), used(0), blockSize(block){}
+	~Arena(){for(size_t i=0; i<blocks.size(); i++) free(blocks[i].data);}
+	/** Returns size bytes of uninitialized memory aligned to align (a power of two), valid until the next reset(). */
+	void* allocate(size_t size, size_t align){
+		for(;;){
+			if(current < blocks.size()){
+				Block& b = blocks[current]; size_t start = (used+align-1)&~(align-1);
+				if(start+size <= b.size){used = start+size; return b.data+start;}
+				if(current+1 < blocks.size()){current++; used = 0; continue;}
+			} Block b = {(char*)malloc(max(blockSize, size+align)), max(blockSize, size+align)};
+			if(b.data == NULL) throw std::bad_alloc();
+			if(current < blocks.size()) current++;
+			blocks.insert(blocks.begin()+current, b); used = 0;
+		}
+	}
+	/** Releases every allocation at once, keeping the blocks for reuse. */
+	inline void reset(){current = 0; used = 0;}
+	/** Returns the total bytes of the blocks owned by this arena. */
+	size_t getCapacity() const {size_t s = 0; for(size_t i=0; i<blocks.size(); i++) s += blocks[i].size; return s;}
+};
+
+/** An STL allocator that allocates from an Arena. Deallocation does nothing; memory is returned when the arena is reset,
+ * so containers using it must not outlive the reset. */
+template<class T> class ArenaAllocator {
+public:
+	typedef T value_type;
+	template<class U> struct rebind {typedef ArenaAllocator<U> other;};
+	Arena* arena;
+	inline ArenaAllocator(Arena* a) : arena(a){}
+	template<class U> inline ArenaAllocator(const ArenaAllocator<U>& a) : arena(a.arena){}
+	inline T* allocate(size_t n){return (T*)arena->allocate(n*sizeof(T), alignof(T));}
+	inline void deallocate(T*, size_t){}
+	template<class U> inline bool operator==(const ArenaAllocator<U>& a) const {return arena == a.arena;}
+	template<class U> inline bool operator!=(const ArenaAllocator<U>& a) const {return arena != a.arena;}
+};
+
+/** A std::vector allocated from an Arena. */
+template<class T> struct ArenaVector {typedef std::vector<T, ArenaAllocator<T> > type;};
+/** A std::string allocated from an Arena. */
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+/** A hash function for ArenaString (32-bit FNV-1a), since std::hash is only defined for std::string. */
+struct ArenaStringHash {
+	inline size_t operator()(const ArenaString& s) const {
+		uint32_t h = 2166136261u; for(size_t i=0; i<s.size(); i++){h ^= (uchar)s[i]; h *= 16777619u;} return h;
+	}
+};
+
+#endif // CORE_ARENA_H_INCLUDED
@@ -0,0 +1,131 @@
+/** @file FuzzScene.cpp
+ * libFuzzer target for the conversion: builds an assimp scene from the input, with the malformed data importers can
+ * produce (faces that are not triangles or are degenerate, more than four bone weights per vertex, zero and
+ * non-finite values, zero rotations, out of range references and trees deeper than the conversion allows), runs
+ * sanitizeScene on it and converts whatever it accepts with options also taken from the input. It includes
+ * Main.cpp, so it links against assimp and builds on Windows (with clang-cl) like CreateWOBJ. See the README for how
+ * to build and run it.
+ */
+
+#define main createWOBJMain
+#include "Main.cpp"
+#undef main
+
+#include <cstddef>
+#include <limits>
+#include <stdint.h>
+#include <vector>
+
+/** Reads values from the fuzz input, returning 0 once it runs out. */
+class FuzzInput {
+	const uint8_t* data; size_t size, pos;
+public:
+	FuzzInput(const uint8_t* data, size_t size) : data(data), size(size), pos(0){}
+	inline uint byte(){return pos < size?data[pos++]:0;}
+	/** Returns a number below n, or 0 if n is 0. */
+	inline uint below(uint n){uint v = byte(); v |= byte() << 8; return n > 0?v%n:0;}
+	/** Returns a small value most of the time, and otherwise four raw bytes, so NaN, infinity and huge values
+	 * come up as well. */
+	float value(){
+		uint b = byte(); if(b >= 32) return ((int)b-144)/16.0f;
+		uint bits = byte() | (byte() << 8) | (byte() << 16) | (byte() << 24); float f; memcpy(&f, &bits, 4); return f;
+	}
+	inline aiVector3D vector(){float x = value(), y = value(); return aiVector3D(x, y, value());}
+};
+
+aiString nodeName(uint i){std::ostringstream s; s << "n" << i; aiString name; name.Set(s.str()); return name;}
+
+/** Builds a node tree of up to 64 nodes, or a chain of more than MAX_NODE_DEPTH nodes. Returns the root. */
+aiNode* makeTree(FuzzInput& in, uint nMeshes, uint& nNodes){
+	bool chain = in.byte() < 8; nNodes = chain?MAX_NODE_DEPTH+1+in.below(16):1+in.below(64);
+	std::vector<aiNode*> nodes(nNodes); std::vector<std::vector<aiNode*> > children(nNodes);
+	for(uint i=0; i<nNodes; i++){
+		aiNode* node = nodes[i] = new aiNode(); node->mName = nodeName(i);
+		if(i > 0){uint parent = chain?i-1:in.below(i); node->mParent = nodes[parent]; children[parent].push_back(node);}
+		if(in.byte() < 64) for(int j=0; j<16; j++) (&node->mTransformation.a1)[j] = in.value();
+		if(in.byte() < 96){node->mNumMeshes = 1+in.below(2); node->mMeshes = new uint[node->mNumMeshes]; for(uint m=0; m<node->mNumMeshes; m++) node->mMeshes[m] = in.below(nMeshes+(in.byte() < 4?1:0));}
+	} for(uint i=0; i<nNodes; i++) if(!children[i].empty()){
+		nodes[i]->mNumChildren = (uint)children[i].size(); nodes[i]->mChildren = new aiNode*[children[i].size()];
+		for(size_t c=0; c<children[i].size(); c++) nodes[i]->mChildren[c] = children[i][c];
+	} return nodes[0];
+}
+aiMesh* makeMesh(FuzzInput& in, uint nNodes, uint nMaterials){
+	aiMesh* mesh = new aiMesh(); uint nv = in.below(64); mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE; mesh->mNumVertices = nv;
+	mesh->mMaterialIndex = in.below(nMaterials+(in.byte() < 8?2:0));
+	mesh->mVertices = new aiVector3D[nv]; for(uint v=0; v<nv; v++) mesh->mVertices[v] = in.vector();
+	if(in.byte() < 192){mesh->mNormals = new aiVector3D[nv]; for(uint v=0; v<nv; v++) mesh->mNormals[v] = in.byte() < 32?aiVector3D():in.vector();}
+	if(in.byte() < 128){mesh->mTextureCoords[0] = new aiVector3D[nv]; mesh->mNumUVComponents[0] = 2; for(uint v=0; v<nv; v++) mesh->mTextureCoords[0][v] = in.vector();}
+	mesh->mNumFaces = in.below(64); mesh->mFaces = new aiFace[mesh->mNumFaces];
+	for(uint f=0; f<mesh->mNumFaces; f++){
+		aiFace& face = mesh->mFaces[f]; face.mNumIndices = in.byte() < 16?in.below(5):3; face.mIndices = new uint[face.mNumIndices];
+		for(uint i=0; i<face.mNumIndices; i++) face.mIndices[i] = in.below(nv+(in.byte() < 8?2:0));
+	} mesh->mNumBones = in.below(9); mesh->mBones = new aiBone*[mesh->mNumBones];
+	for(uint b=0; b<mesh->mNumBones; b++){
+		aiBone* bone = mesh->mBones[b] = new aiBone(); bone->mName = nodeName(in.below(nNodes+1));
+		if(in.byte() < 16) for(int j=0; j<16; j++) (&bone->mOffsetMatrix.a1)[j] = in.value();
+		bone->mNumWeights = in.below(nv*2+1); bone->mWeights = new aiVertexWeight[bone->mNumWeights];
+		for(uint w=0; w<bone->mNumWeights; w++){bone->mWeights[w].mVertexId = in.below(nv+(in.byte() < 8?2:0)); bone->mWeights[w].mWeight = in.value();}
+	} mesh->mNumAnimMeshes = in.byte() < 64?1+in.below(3):0; mesh->mAnimMeshes = new aiAnimMesh*[mesh->mNumAnimMeshes];
+	for(uint t=0; t<mesh->mNumAnimMeshes; t++){
+		aiAnimMesh* am = mesh->mAnimMeshes[t] = new aiAnimMesh(); am->mNumVertices = in.byte() < 16?in.below(nv+1):nv;
+		am->mVertices = new aiVector3D[am->mNumVertices]; for(uint v=0; v<am->mNumVertices; v++) am->mVertices[v] = in.vector();
+		if(in.byte() < 128){am->mNormals = new aiVector3D[am->mNumVertices]; for(uint v=0; v<am->mNumVertices; v++) am->mNormals[v] = in.vector();}
+	} return mesh;
+}
+void setKeyValue(FuzzInput& in, aiVectorKey& key){key.mValue = in.vector();}
+void setKeyValue(FuzzInput& in, aiQuatKey& key){
+	if(in.byte() < 16) key.mValue = aiQuaternion(0, 0, 0, 0);
+	else {float w = in.value(), x = in.value(), y = in.value(); key.mValue = aiQuaternion(w, x, y, in.value());}
+}
+/** Fills a track with up to 8 keys, mostly in order, with some out of order or at NaN times. */
+template<class K> void makeTrack(FuzzInput& in, K*& keys, uint& count){
+	count = in.below(9); keys = new K[count];
+	for(uint k=0; k<count; k++){
+		keys[k].mTime = in.byte() < 16?(in.byte() < 128?std::numeric_limits<double>::quiet_NaN():-(double)in.below(8)):k*(1+in.below(4));
+		setKeyValue(in, keys[k]);
+	}
+}
+aiAnimation* makeAnimation(FuzzInput& in, uint index, uint nNodes){
+	aiAnimation* anim = new aiAnimation(); anim->mName = nodeName(1000+index);
+	// durations and tick rates are kept small, since baking is linear in their ratio
+	anim->mDuration = in.byte() < 16?in.value():in.below(32); anim->mTicksPerSecond = in.byte() < 16?in.value():1+in.below(60);
+	if(anim->mDuration > 64) anim->mDuration = 64; if(anim->mTicksPerSecond > 0 && anim->mTicksPerSecond < 1) anim->mTicksPerSecond = 1;
+	anim->mNumChannels = in.below(6); anim->mChannels = new aiNodeAnim*[anim->mNumChannels];
+	for(uint c=0; c<anim->mNumChannels; c++){
+		aiNodeAnim* ch = anim->mChannels[c] = new aiNodeAnim(); ch->mNodeName = nodeName(in.below(nNodes+1));
+		makeTrack(in, ch->mPositionKeys, ch->mNumPositionKeys); makeTrack(in, ch->mRotationKeys, ch->mNumRotationKeys); makeTrack(in, ch->mScalingKeys, ch->mNumScalingKeys);
+	} anim->mNumMorphMeshChannels = in.below(3); anim->mMorphMeshChannels = new aiMeshMorphAnim*[anim->mNumMorphMeshChannels];
+	for(uint c=0; c<anim->mNumMorphMeshChannels; c++){
+		aiMeshMorphAnim* ch = anim->mMorphMeshChannels[c] = new aiMeshMorphAnim(); ch->mName = nodeName(in.below(nNodes+1));
+		ch->mNumKeys = in.below(5); ch->mKeys = new aiMeshMorphKey[ch->mNumKeys];
+		for(uint k=0; k<ch->mNumKeys; k++){
+			aiMeshMorphKey& key = ch->mKeys[k]; key.mTime = k*(1+in.below(4)); key.mNumValuesAndWeights = in.below(4);
+			key.mValues = new uint[key.mNumValuesAndWeights]; key.mWeights = new double[key.mNumValuesAndWeights];
+			for(uint j=0; j<key.mNumValuesAndWeights; j++){key.mValues[j] = in.below(4); key.mWeights[j] = in.value();}
+		}
+	} return anim;
+}
+
+/** Sets the conversion options from the input, following the rules main checks them by. */
+void setOptions(FuzzInput& in){
+	uint a = in.byte(), b = in.byte(), mode = (a >> 4)&3; meshes.clear(); THREADS = 1+(a >> 6);
+	NO_SCALE = (a&1) != 0; DUAL_QUAT = (a&2) != 0; WRITE_MESHES = (a&4) != 0; LARGE_OUTPUT = (a&8) != 0;
+	INSTANCE_MESHES = mode == 1; GROUP_MATERIALS = mode == 2; TILE_SIZE = mode == 3?1.0f:0;
+	BAKE_RATE = (b&1)?10.0f:0; VAT_RATE = (mode == 0 && (b&2))?10.0f:0; MORPH_TARGETS = mode == 0 && (b&4); VERIFY = mode == 0 && (b&8);
+	ADDITIVE_REFERENCE = (b&16)?"bind":NULL; ROOT_MOTION_NODE = (b&32)?"n1":NULL; QUAT_TOLERANCE = (b&64)?0.01f:0.00002f;
+	DROP_REST = (b&128) != 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+	FuzzInput in(data, size); setOptions(in);
+	aiScene* scene = new aiScene(); uint nNodes;
+	scene->mNumMaterials = 1+in.below(2); scene->mMaterials = new aiMaterial*[scene->mNumMaterials];
+	for(uint i=0; i<scene->mNumMaterials; i++) scene->mMaterials[i] = new aiMaterial();
+	scene->mNumMeshes = 1+in.below(4); scene->mMeshes = new aiMesh*[scene->mNumMeshes];
+	scene->mRootNode = makeTree(in, scene->mNumMeshes, nNodes);
+	for(uint i=0; i<scene->mNumMeshes; i++) scene->mMeshes[i] = makeMesh(in, nNodes, scene->mNumMaterials);
+	scene->mNumAnimations = in.below(3); scene->mAnimations = new aiAnimation*[scene->mNumAnimations];
+	for(uint i=0; i<scene->mNumAnimations; i++) scene->mAnimations[i] = makeAnimation(in, i, nNodes);
+	if(sanitizeScene(scene)){Arena arena; loadScene("fuzz.wobj", scene, arena);}
+	delete scene; return 0;
+}
@@ -0,0 +1,33 @@
+/** @file FuzzWOBJReader.cpp
+ * libFuzzer target for WOBJReader.h and AnimSampler.h: reads the input as a WOBJ file and, if it loads, samples,
+ * evaluates and skins every animation with both palettes, so malformed files that get past the reader are run
+ * through everything a runtime would do with them. Like CreateWOBJ, it builds on Windows (with clang-cl); see the
+ * README for how to build and run it.
+ */
+
+#include "AnimSampler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/** The most vertices skinned per pose, which keeps each input fast enough to fuzz. */
+const longlong MAX_FUZZ_VERTICES = 256;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+	WOBJFile file; if(!file.read(data, size)) return 0;
+	std::vector<DualQuat> binds; readDualQuatBinds(file, binds);
+	if(file.animations.empty()) return 0;
+	AnimSampler sampler(file); int nBones = sampler.getBoneCount();
+	std::vector<Mat4> palette(nBones+1); std::vector<DualQuat> dualQuats(nBones+1);
+	longlong count = std::min(file.vertexCount, MAX_FUZZ_VERTICES); std::vector<float> skinned(count*6+1);
+	for(size_t a=0; a<file.animations.size(); a++) for(int i=0; i<4; i++){
+		// sample at the start, inside and past the end, and blend another animation additively on top
+		float t = file.animations[a].duration*i/3; sampler.reset(); sampler.sample((int)a, t);
+		sampler.sampleAdditive((int)((a+1)%file.animations.size()), t, 0.5f); sampler.evaluate();
+		sampler.getPalette(&palette[0]); sampler.getDualQuatPalette(&dualQuats[0]);
+		skinVertices(file, &palette[0], nBones, 0, count, &skinned[0]); skinVerticesDualQuat(file, &dualQuats[0], nBones, 0, count, &skinned[0]);
+		skinVertices(file, &palette[0], nBones, file.vertexCount-count/2, count, &skinned[0]);
+	} return 0;
+}
@@ -1,16 +1,28 @@
 #include <assimp/cimport.h>
+#include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "AnimSampler.h"
+#include "Arena.h"
+#include "MappedFile.h"
+#include "PostProcess.h"
+#include "SanitizeScene.h"
 #include "VertexFormat.h"
 #include "BBox.h"
 #include "BooleanArray.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fcntl.h>
+#include <iomanip>
 #include <io.h>
 #include <iostream>
-#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
 enum {POSITION = 0, NORMAL = 1, TEX_COORD = 2, BONE_IDX = 3, BONE_WEIGHT = 4};
@@ -22,23 +34,36 @@ struct Bone {
 	inline Bone(uint i, const aiMatrix4x4& t) : id(i), transform(t){}
 };
 
+/** A map from names to values, with the names and the map itself allocated from an Arena. */
+template<class V> struct ArenaMap {
+	typedef std::unordered_map<ArenaString, V, ArenaStringHash, std::equal_to<ArenaString>, ArenaAllocator<std::pair<const ArenaString, V> > > type;
+};
+typedef ArenaMap<int>::type NodeMap;
+typedef ArenaVector<std::pair<const aiNode*, int> >::type NodeList;
+
 class BoneData {
 public:
-	std::unordered_map<std::string, Bone> bones;
+	typedef ArenaMap<Bone>::type BoneMap;
+	Arena& arena; BoneMap bones;
+	inline BoneData(Arena& a) : arena(a), bones(16, ArenaStringHash(), std::equal_to<ArenaString>(), BoneMap::allocator_type(&a)){}
+	/** Returns the passed name as an ArenaString for looking up bones. */
+	inline ArenaString key(const char* name) const {return ArenaString(name, ArenaAllocator<char>(&arena));}
+	/** Returns the name of the bone generated for vertices of the passed node that are not weighted to any bone. */
+	inline ArenaString autoKey(const aiString& name) const {ArenaString k = key(name.C_Str()); k += "_auto"; return k;}
 };
 
 struct MeshSubset {
-	aiString name; int start; int end;
-	inline MeshSubset(const aiString& n, int st, int e) : name(n), start(st), end(e){}
+	aiString name; longlong start; longlong end;
+	inline MeshSubset(const aiString& n, longlong st, longlong e) : name(n), start(st), end(e){}
 };
 
 std::vector<MeshSubset> meshes;
 
-void getVertexCount(const aiScene* scene, const aiNode* node, int& vcount, int& icount, BoneData& bones){
+void getVertexCount(const aiScene* scene, const aiNode* node, longlong& vcount, longlong& icount, BoneData& bones){
 	for(uint i=0; i<node->mNumMeshes; i++){
 		uint mesh_id = node->mMeshes[i]; const aiMesh* mesh = scene->mMeshes[mesh_id];
 		if(mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || !mesh->HasPositions() || !mesh->HasFaces()) continue;
-		meshes.push_back(MeshSubset(mesh->mName, icount, icount+mesh->mNumFaces*3)); vcount += mesh->mNumVertices; icount += mesh->mNumFaces*3;
+		meshes.push_back(MeshSubset(mesh->mName, icount, icount+(longlong)mesh->mNumFaces*3)); vcount += mesh->mNumVertices; icount += (longlong)mesh->mNumFaces*3;
 	} for(uint i=0; i<node->mNumChildren; i++) getVertexCount(scene, node->mChildren[i], vcount, icount, bones);
 }
 
@@ -54,8 +79,8 @@ float3 mul(const aiMatrix3x3& transform, const float3& p){
 		transform.c1*p.x+transform.c2*p.y+transform.c3*p.z);
 }
 
-uint getNodeBone(BoneData& bones, int& index, const std::string& name, const aiMatrix4x4& transform){
-	std::unordered_map<std::string,Bone>::const_iterator i = bones.bones.find(name);
+uint getNodeBone(BoneData& bones, int& index, const ArenaString& name, const aiMatrix4x4& transform){
+	BoneData::BoneMap::const_iterator i = bones.bones.find(name);
 	if(i == bones.bones.end()){
 		std::cout << "Bone: " << name.c_str() << " = " << index << std::endl;
 		aiMatrix4x4 t = transform; t.Inverse();
@@ -73,11 +98,12 @@ aiMatrix4x4 getAbsolute(const aiNode* n){
 	aiMatrix4x4 m = n->mTransformation; while(n->mParent != NULL){n = n->mParent; m = n->mTransformation*m;} return m;
 }
 
-bool loadMesh(const aiScene* scene, int mesh_id, int& index, const aiString& name, const aiMatrix4x4& transform, VertexBuffer& vertices, IndexBuffer& indices, int& voff, int& ioff, BBox3D<double>& bounds, BoneData& bones){
+bool loadMesh(const aiScene* scene, int mesh_id, int& index, const aiString& name, const aiMatrix4x4& transform, VertexBuffer& vertices, IndexBuffer& indices, longlong& voff, longlong& ioff, BBox3D<double>& bounds, BoneData& bones){
 	const aiMesh* mesh = scene->mMeshes[mesh_id];
 	if(mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || !mesh->HasPositions() || !mesh->HasFaces()) return false;
 	aiMatrix3x3 normalMat = aiMatrix3x3(transform); normalMat.Inverse(); normalMat.Transpose();
 	bool hasNormals = mesh->HasNormals(), hasBones = mesh->HasBones(), hasTexCoords = mesh->HasTextureCoords(0);
+	bool weighted = hasBones && scene->HasAnimations(); float4 zero = float4::make(0, 0, 0, 0);
 	for(unsigned int i=0; i<mesh->mNumVertices; i++){
 		aiVector3D v = mesh->mVertices[i]; float4 pos = float4::make(v.x, v.y, v.z, 1);
 		float4 bpos = mul(transform, pos); bounds += double3::make(bpos.x, bpos.y, bpos.z);
@@ -86,22 +112,25 @@ bool loadMesh(const aiScene* scene, int mesh_id, int& index, const aiString& nam
 			v = mesh->mNormals[i]; float3 norm = float3::make(v.x, v.y, v.z);
 			norm = mul(normalMat, norm); normalize_m(norm);
 			vertices.set(voff+i, NORMAL, float4::make(norm.x, norm.y, norm.z, 1));
-		} if(hasTexCoords){
+		} else vertices.set(voff+i, NORMAL, zero);
+		if(hasTexCoords){
 			v = mesh->mTextureCoords[0][i]; vertices.set(voff+i, TEX_COORD, float4::make(v.x, v.y, v.z, 1));
-		}
+		} else vertices.set(voff+i, TEX_COORD, zero);
+		if(weighted){vertices.set(voff+i, BONE_IDX, zero); vertices.set(voff+i, BONE_WEIGHT, zero);}
 	} uint nFaces = mesh->mNumFaces;
 	for(unsigned int f=0; f<nFaces; f++){
 		const aiFace& face = mesh->mFaces[f];
-		for(int i=0; i<3; i++) indices.set(ioff+f*3+i, face.mIndices[i]+voff);
+		for(int i=0; i<3; i++) indices.set(ioff+(longlong)f*3+i, (uint)(face.mIndices[i]+voff));
 	} if(scene->HasAnimations()){
 		if(hasBones){
 			unsigned int numBones = mesh->mNumBones;
 			 for(unsigned int b=0; b<numBones; b++){
 				const aiBone* bone = mesh->mBones[b];
-				std::unordered_map<std::string,Bone>::const_iterator i = bones.bones.find(bone->mName.C_Str()); unsigned int bidx;
+				ArenaString bname = bones.key(bone->mName.C_Str());
+				BoneData::BoneMap::const_iterator i = bones.bones.find(bname); unsigned int bidx;
 				if(i == bones.bones.end()){
 					aiMatrix4x4 t = transform; t.Inverse();
-					bidx = index; index++; bones.bones[bone->mName.C_Str()] = Bone(bidx, bone->mOffsetMatrix*t);
+					bidx = index; index++; bones.bones[bname] = Bone(bidx, bone->mOffsetMatrix*t);
 					std::cout << "Bone: " << bone->mName.C_Str() << " = " << bidx << std::endl;
 				} else bidx = i->second.id;
 				for(unsigned int w=0; w<bone->mNumWeights; w++){
@@ -110,7 +139,10 @@ bool loadMesh(const aiScene* scene, int mesh_id, int& index, const aiString& nam
 					float4 wt = vertices.get(voff+vw.mVertexId, BONE_WEIGHT);
 					uchar minidx=4;
 					for(uchar c=0; c<4; c++) if(wt[c] == 0 || idx[c] == bidx){minidx = c; break;}
-					if(minidx >= 4) continue;
+					if(minidx >= 4){ // keep the four largest weights
+						minidx = 0; for(uchar c=1; c<4; c++) if(wt[c] < wt[minidx]) minidx = c;
+						if(vw.mWeight <= wt[minidx]) continue;
+					}
 					idx[minidx] = (float)bidx; wt[minidx] = vw.mWeight;
 					vertices.set(voff+vw.mVertexId, BONE_IDX, idx);
 					vertices.set(voff+vw.mVertexId, BONE_WEIGHT, wt);
@@ -118,7 +150,7 @@ bool loadMesh(const aiScene* scene, int mesh_id, int& index, const aiString& nam
 			} for(unsigned int i=0; i<mesh->mNumVertices; i++){
 				float4 wt = vertices.get(voff+i, BONE_WEIGHT);
 				if(wt.x == 0){
-					uint default_bone = getNodeBone(bones, index, std::string(name.C_Str())+"_auto", transform);
+					uint default_bone = getNodeBone(bones, index, bones.autoKey(name), transform);
 					wt.x = 1; vertices.set(voff+i, BONE_WEIGHT, wt);
 					vertices.set(voff+i, BONE_IDX, float4::make((float)default_bone,0,0,0));
 					vertices.set(voff+i, BONE_WEIGHT, float4::make(1,0,0,0));
@@ -127,48 +159,76 @@ bool loadMesh(const aiScene* scene, int mesh_id, int& index, const aiString& nam
 				}
 			}
 		} else {
-			uint default_bone = getNodeBone(bones, index, std::string(name.C_Str()) + "_auto", transform);
+			uint default_bone = getNodeBone(bones, index, bones.autoKey(name), transform);
 			for(unsigned int i=0; i<mesh->mNumVertices; i++){
 				vertices.set(voff+i, BONE_IDX, float4::make((float)default_bone,0,0,0));
 				vertices.set(voff+i, BONE_WEIGHT, float4::make(1,0,0,0));
 			}
 		}
-	} voff += mesh->mNumVertices; ioff += nFaces*3; return true;
+	} voff += mesh->mNumVertices; ioff += (longlong)nFaces*3; return true;
 }
 
-void generateMesh(const aiScene* scene, const aiNode* node, int& index, const aiMatrix4x4& transform, VertexBuffer& vertices, IndexBuffer& indices, int& voff, int& ioff, BBox3D<double>& bounds, BoneData& bones){
+/** Keeps memory bounded while converting scenes larger than memory. As each mesh is converted, its finished
+ * vertices and indices are written back to the output file and dropped from memory, and once the last node
+ * referencing a mesh has been converted, the mesh's assimp data is freed. */
+class MeshStreamer {
+	aiScene* scene; MappedOutputFile* output; ulonglong vstart, istart; int bpv, bpi; bool once; std::vector<uint> refs;
+	void countRefs(const aiNode* node){
+		for(uint i=0; i<node->mNumMeshes; i++) refs[node->mMeshes[i]] = once?1:refs[node->mMeshes[i]]+1;
+		for(uint i=0; i<node->mNumChildren; i++) countRefs(node->mChildren[i]);
+	}
+public:
+	/** If once is true, each mesh is converted once no matter how many nodes reference it, as with -instance. */
+	MeshStreamer(aiScene* s, MappedOutputFile* out, ulonglong vs, int vbpv, ulonglong is, int ibpi, bool o) : scene(s),
+		output(out), vstart(vs), istart(is), bpv(vbpv), bpi(ibpi), once(o), refs(s->mNumMeshes, 0) {countRefs(s->mRootNode);}
+	/** Called after a node's mesh has been converted into the passed vertex and index ranges. */
+	void meshDone(uint mesh_id, longlong vfrom, longlong vto, longlong ifrom, longlong ito){
+		output->release(vstart+(ulonglong)vfrom*bpv, (ulonglong)(vto-vfrom)*bpv);
+		output->release(istart+(ulonglong)ifrom*bpi, (ulonglong)(ito-ifrom)*bpi);
+		if(--refs[mesh_id] == 0){delete scene->mMeshes[mesh_id]; scene->mMeshes[mesh_id] = NULL;}
+	}
+};
+
+bool STREAM_MESHES = false;
+void generateMesh(const aiScene* scene, const aiNode* node, int& index, const aiMatrix4x4& transform, VertexBuffer& vertices, IndexBuffer& indices, longlong& voff, longlong& ioff, BBox3D<double>& bounds, BoneData& bones, MeshStreamer* stream){
 	aiMatrix4x4 mat = transform*node->mTransformation;
 	std::cout << "Node: " << node->mName.C_Str() << ", Children: " << node->mNumChildren << ", Meshes: " << node->mNumMeshes << std::endl;
 	for(uint i=0; i<node->mNumMeshes; i++){
+		longlong vfrom = voff, ifrom = ioff;
 		loadMesh(scene, node->mMeshes[i], index, node->mName, mat, vertices, indices, voff, ioff, bounds, bones);
-	} for(uint i=0; i<node->mNumChildren; i++) generateMesh(scene, node->mChildren[i], index, mat, vertices, indices, voff, ioff, bounds, bones);
+		if(stream != NULL) stream->meshDone(node->mMeshes[i], vfrom, voff, ifrom, ioff);
+	} for(uint i=0; i<node->mNumChildren; i++) generateMesh(scene, node->mChildren[i], index, mat, vertices, indices, voff, ioff, bounds, bones, stream);
 
 }
 
-const aiNode* loadTree(std::vector<std::pair<const aiNode*, int> >& nodes, const aiNode* node, int cur, int& index, std::unordered_map<std::string, int>& node_map, const BoneData& bones){
+const aiNode* loadTree(NodeList& nodes, const aiNode* node, int cur, int& index, NodeMap& node_map, const BoneData& bones){
 	int len = node->mNumChildren; int childIdx = index; index += len; const aiNode* ret = NULL;
-	if(node->mNumMeshes == 0 && node_map.find(node->mName.C_Str()) == node_map.end()) node_map[node->mName.C_Str()] = cur;
+	ArenaString name = bones.key(node->mName.C_Str());
+	if(node->mNumMeshes == 0 && node_map.find(name) == node_map.end()) node_map[name] = cur;
 	if(nodes.size() <= cur) nodes.resize(cur+1); nodes[cur] = std::make_pair(node, childIdx);
 	for(uint i=0; i<len; i++){const aiNode* r = loadTree(nodes, node->mChildren[i], childIdx+i, index, node_map, bones); if(ret == NULL) ret = r;} return ret;
 }
 
-void writeByte(std::ofstream& file, char f){file.write(&f, 1);}
-void writeShort(std::ofstream& file, short f){
+void writeByte(std::ostream& file, char f){file.write(&f, 1);}
+void writeShort(std::ostream& file, short f){
 	file.write(reinterpret_cast<const char *>(&f), 2);
 }
-void writeInt(std::ofstream& file, int f){
+void writeInt(std::ostream& file, int f){
 	file.write(reinterpret_cast<const char *>(&f), 4);
 }
-void writeFloat(std::ofstream& file, float f){
+void writeLong(std::ostream& file, longlong f){
+	file.write(reinterpret_cast<const char *>(&f), 8);
+}
+void writeFloat(std::ostream& file, float f){
 	file.write(reinterpret_cast<const char *>(&f), 4);
 }
-void writeUTF(std::ofstream& file, const aiString& s){
+void writeUTF(std::ostream& file, const aiString& s){
 	ushort len = s.length; writeShort(file, len); file.write(s.C_Str(), len);
 }
 bool equalsFuzzy(const float3& a, const float3& b, float d) {return abs(a.x-b.x)<d && abs(a.y-b.y)<d && abs(a.z-b.z)<d;}
 bool equalsFuzzy(const aiQuaternion& a, const aiQuaternion& b, float d) {return abs(a.x-b.x)<d && abs(a.y-b.y)<d && abs(a.z-b.z)<d && abs(a.w-b.w)<d;}
-void writeVectorArray(std::ofstream& file, aiVectorKey* keys, uint count){
-	std::vector<uint> ar; 
+void writeVectorArray(std::ostream& file, const aiVectorKey* keys, uint count, Arena& arena){
+	ArenaVector<uint>::type ar(&arena);
 	for(uint i=0; i<count; i++){
 		const aiVectorKey& k = keys[i];
 		if(i > 0 && i < count-1){
@@ -181,98 +241,999 @@ void writeVectorArray(std::ofstream& file, aiVectorKey* keys, uint count){
 		const aiVectorKey& k = keys[ar[i]]; writeFloat(file, k.mTime); writeFloat(file, k.mValue.x); writeFloat(file, k.mValue.y); writeFloat(file, k.mValue.z);
 	}
 }
-void writeQuatArray(std::ofstream& file, aiQuatKey* keys, uint count){
-	std::vector<uint> ar;
-	for(uint i=0; i<count; i++){
-		const aiQuatKey& k = keys[i];
-		if(i > 0 && i < count-1){
-			const aiQuatKey& prev = keys[ar[ar.size()-1]];
-			const aiQuaternion& from = prev.mValue;
-			const aiQuaternion& to = keys[i+1].mValue;
-			aiQuaternion est; from.Interpolate(est, from, to, (k.mTime-prev.mTime)/(keys[i+1].mTime-prev.mTime));
-			if(equalsFuzzy(est, k.mValue, 0.00001)) continue;
-		} else if(i == count-1 && i > 0 && equalsFuzzy(keys[ar[ar.size()-1]].mValue, k.mValue, 0.00001)) continue;
-		ar.push_back(i);
+template<class T> T* copyKeys(const T* keys, uint count, Arena& arena){
+	T* r = (T*)arena.allocate(max(count, 1u)*sizeof(T), alignof(T)); for(uint i=0; i<count; i++) r[i] = keys[i]; return r;
+}
+/** How far in radians a rotation key can be from the rotation interpolated between the keys around it and still be
+ * removed. Set in degrees with -quaterror. The default of 0.001 degrees is about the precision of comparing each
+ * component to 0.00001, which rotation keys were reduced with before. */
+float QUAT_TOLERANCE = 0.001f*(float)AI_MATH_PI/180;
+/** The most keys apart two kept rotation keys can be, which bounds the cost of reducing a track to linear in its
+ * key count. */
+const uint MAX_QUAT_SPAN = 256;
+/** Returns the angle in radians of the rotation from a to b, treating q and -q as the same rotation. */
+inline float quatAngle(const aiQuaternion& a, const aiQuaternion& b){
+	aiQuaternion r = a; r.Conjugate(); r = r*b; return 2*atan2(sqrt(r.x*r.x+r.y*r.y+r.z*r.z), abs(r.w));
+}
+/** Returns true if every key between keys from and to is within QUAT_TOLERANCE of the rotation interpolated
+ * between them, so they can all be removed. */
+bool canInterpolate(const aiQuatKey* keys, uint from, uint to){
+	for(uint i=from+1; i<to; i++){
+		aiQuaternion est = keys[from].mValue; double span = keys[to].mTime-keys[from].mTime;
+		if(span > 0) aiQuaternion::Interpolate(est, keys[from].mValue, keys[to].mValue, (float)((keys[i].mTime-keys[from].mTime)/span));
+		if(quatAngle(est, keys[i].mValue) > QUAT_TOLERANCE) return false;
+	} return true;
+}
+/** Writes a rotation track, removing keys greedily: from each kept key, the next kept key is the furthest one, at
+ * most MAX_QUAT_SPAN keys on, that every key in between can be interpolated from, and once the rest of the track
+ * stays within the tolerance of a kept key it is dropped, since tracks are clamped to their last key. The rest of
+ * the track is bounded by its furthest key from the last key, so checking it takes constant time. Keys are flipped
+ * where needed so each is in the same hemisphere as the one before, which makes interpolation take the short way
+ * around even if a runtime does not check for it. */
+void writeQuatArray(std::ostream& file, const aiQuatKey* keys, uint count, Arena& arena){
+	aiQuatKey* q = copyKeys(keys, count, arena); ArenaVector<uint>::type ar(&arena); ArenaVector<float>::type tail(count+1, 0, &arena);
+	for(uint i=1; i<count; i++){
+		aiQuaternion& v = q[i].mValue; const aiQuaternion& p = q[i-1].mValue;
+		if(v.w*p.w+v.x*p.x+v.y*p.y+v.z*p.z < 0){v.w = -v.w; v.x = -v.x; v.y = -v.y; v.z = -v.z;}
+	} // tail[i] is the furthest any key from i on is from the last key
+	for(uint i=count; i-- > 0;) tail[i] = max(tail[i+1], quatAngle(q[i].mValue, q[count-1].mValue));
+	for(uint a=0; count > 0;){
+		ar.push_back(a); if(a == count-1) break;
+		if(quatAngle(q[a].mValue, q[count-1].mValue)+tail[a+1] <= QUAT_TOLERANCE) break; // every later key is within the tolerance of key a
+		uint b = a+1; while(b+1 < count && b+1-a <= MAX_QUAT_SPAN && canInterpolate(q, a, b+1)) b++;
+		a = b;
 	} writeInt(file, ar.size()*5); for(uint i=0; i<ar.size(); i++){
-		const aiQuatKey& k = keys[ar[i]]; writeFloat(file, k.mTime); writeFloat(file, k.mValue.w);
+		const aiQuatKey& k = q[ar[i]]; writeFloat(file, k.mTime); writeFloat(file, k.mValue.w);
 		writeFloat(file, k.mValue.x); writeFloat(file, k.mValue.y); writeFloat(file, k.mValue.z);
 	}
 }
 
+const aiNode* findNode(const aiNode* node, const aiString& name){
+	if(node->mName == name) return node;
+	for(uint i=0; i<node->mNumChildren; i++){const aiNode* n = findNode(node->mChildren[i], name); if(n != NULL) return n;}
+	return NULL;
+}
+/** The pose an additive animation channel is stored relative to. */
+struct ChannelReference {
+	aiVector3D position, scaling; aiQuaternion rotation;
+	inline ChannelReference() : scaling(1, 1, 1){}
+};
+/** Returns the reference pose of a node for additive animations: the first keys of the base animation's channel
+ * for the node, or the node's bind transform if there is no base animation or it does not animate the node. */
+ChannelReference getReference(const aiScene* scene, const aiAnimation* base, const aiString& name){
+	ChannelReference ref; const aiNodeAnim* ch = NULL;
+	for(uint i=0; base != NULL && i<base->mNumChannels; i++) if(base->mChannels[i]->mNodeName == name) ch = base->mChannels[i];
+	const aiNode* node = findNode(scene->mRootNode, name); if(node != NULL) node->mTransformation.Decompose(ref.scaling, ref.rotation, ref.position);
+	if(ch != NULL && ch->mNumPositionKeys > 0) ref.position = ch->mPositionKeys[0].mValue;
+	if(ch != NULL && ch->mNumRotationKeys > 0) ref.rotation = ch->mRotationKeys[0].mValue;
+	if(ch != NULL && ch->mNumScalingKeys > 0) ref.scaling = ch->mScalingKeys[0].mValue;
+	return ref;
+}
+
+const char* ROOT_MOTION_NODE = NULL;
+/** Returns the rotation and scale from a node's parent space to the space of the WOBJ file in the bind pose:
+ * the axis swap times the transforms of the node's ancestors. */
+aiMatrix3x3 getParentToWOBJ(const aiNode* node){
+	aiMatrix4x4 m; for(const aiNode* p = node->mParent; p != NULL; p = p->mParent) m = p->mTransformation*m;
+	return aiMatrix3x3(aiMatrix4x4(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1)*m);
+}
+/** Extracts root motion from a channel's position keys: how far across the ground each key has moved from the
+ * first key, in the space of the WOBJ file (z up, so z is always 0). Writes one key per position key to motion. */
+void getRootMotion(const aiNode* node, const aiNodeAnim* n, aiVectorKey* motion){
+	aiMatrix3x3 toWOBJ = getParentToWOBJ(node);
+	for(uint k=0; k<n->mNumPositionKeys; k++){
+		aiVector3D d = toWOBJ*(n->mPositionKeys[k].mValue-n->mPositionKeys[0].mValue); d.z = 0; motion[k] = aiVectorKey(n->mPositionKeys[k].mTime, d);
+	}
+}
+
 bool NO_SCALE = false; bool WRITE_MESHES = false;
-void loadAnimation(std::ofstream& file, const aiScene* scene, const aiAnimation* anim, const std::unordered_map<std::string, int>& node_map){
-	writeUTF(file, anim->mName); std::cout << "Animation: " << anim->mName.C_Str() << std::endl;
-	writeFloat(file, anim->mDuration); writeInt(file, anim->mNumChannels);
-	for(uint i=0; i<anim->mNumChannels; i++){
-		const aiNodeAnim* n = anim->mChannels[i];
-		std::unordered_map<std::string,int>::const_iterator it = node_map.find(n->mNodeName.C_Str());
-		if(it == node_map.end()) continue; writeShort(file, it->second);
-		writeVectorArray(file, n->mPositionKeys, n->mNumPositionKeys);
-		writeQuatArray(file, n->mRotationKeys, n->mNumRotationKeys);
-		if(NO_SCALE){
-			writeInt(file, 4); writeFloat(file, 0); writeFloat(file, 1); writeFloat(file, 1); writeFloat(file, 1);
-		} else writeVectorArray(file, n->mScalingKeys, n->mNumScalingKeys);
+const char* ADDITIVE_REFERENCE = NULL;
+/** Leaves out tracks and channels at rest (-droprest). Off by default: it changes the format, since tracks can then
+ * have no keys and animated nodes no channel, which loaders written for the original format do not expect. */
+bool DROP_REST = false;
+/** How far a key can be from a track's rest value and still be treated as at rest. */
+const float STATIC_EPSILON = 0.0001f;
+/** The keys of an animation channel as they are written, and the rest values its tracks are left out at: the
+ * node's bind transform, or no change for additive animations, which is also what a runtime uses for a track
+ * with no keys or a node with no channel. */
+struct ChannelTracks {
+	const aiVectorKey* positions; const aiQuatKey* rotations; const aiVectorKey* scalings; uint numPositions, numRotations, numScalings;
+	aiVector3D restPosition, restScaling; aiQuaternion restRotation;
+};
+/** Returns the keys of a channel to write. The root motion of the ROOT_MOTION_NODE is removed from its position
+ * keys, leaving it in place over the ground. If additive is true, every key is stored relative to the reference
+ * pose from getReference(): positions as offsets from the reference position, rotations as the rotation applied
+ * after the reference rotation, and scales as factors of the reference scale. Deltas are close to zero (or
+ * identity) and key reduction removes far more of them than absolute keys. With NO_SCALE, the scale track is a
+ * single key of 1. */
+ChannelTracks getTracks(const aiScene* scene, const aiNodeAnim* n, Arena& arena, bool additive, const aiAnimation* base){
+	ChannelTracks t; t.positions = n->mPositionKeys; t.rotations = n->mRotationKeys; t.scalings = n->mScalingKeys;
+	t.numPositions = n->mNumPositionKeys; t.numRotations = n->mNumRotationKeys; t.numScalings = n->mNumScalingKeys; t.restScaling = aiVector3D(1, 1, 1);
+	const aiNode* node = findNode(scene->mRootNode, n->mNodeName); if(!additive && node != NULL) node->mTransformation.Decompose(t.restScaling, t.restRotation, t.restPosition);
+	if(ROOT_MOTION_NODE != NULL && node != NULL && strcmp(n->mNodeName.C_Str(), ROOT_MOTION_NODE) == 0){
+		aiVectorKey* pos = copyKeys(n->mPositionKeys, n->mNumPositionKeys, arena), *motion = copyKeys(n->mPositionKeys, n->mNumPositionKeys, arena);
+		getRootMotion(node, n, motion); aiMatrix3x3 toParent = getParentToWOBJ(node); toParent.Inverse();
+		for(uint k=0; k<t.numPositions; k++) pos[k].mValue = pos[k].mValue-toParent*motion[k].mValue;
+		t.positions = pos;
+	} if(additive){
+		ChannelReference ref = getReference(scene, base, n->mNodeName); aiQuaternion inv = ref.rotation; inv.Conjugate();
+		aiVectorKey* dpos = copyKeys(t.positions, t.numPositions, arena); aiQuatKey* drot = copyKeys(t.rotations, t.numRotations, arena);
+		aiVectorKey* dscale = copyKeys(t.scalings, t.numScalings, arena);
+		for(uint k=0; k<t.numPositions; k++) dpos[k].mValue = dpos[k].mValue-ref.position;
+		for(uint k=0; k<t.numRotations; k++){aiQuaternion& q = drot[k].mValue; q = inv*q; if(q.w < 0){q.w = -q.w; q.x = -q.x; q.y = -q.y; q.z = -q.z;}}
+		for(uint k=0; k<t.numScalings; k++){
+			aiVector3D& s = dscale[k].mValue; s.x = (ref.scaling.x != 0)?s.x/ref.scaling.x:1;
+			s.y = (ref.scaling.y != 0)?s.y/ref.scaling.y:1; s.z = (ref.scaling.z != 0)?s.z/ref.scaling.z:1;
+		} t.positions = dpos; t.rotations = drot; t.scalings = dscale;
+	} if(NO_SCALE){
+		aiVectorKey* one = copyKeys(n->mScalingKeys, 0, arena); *one = aiVectorKey(0, aiVector3D(1, 1, 1)); t.scalings = one; t.numScalings = 1;
+	} return t;
+}
+/** Returns true if every key of a track is at its rest value, so the track can be left out. */
+bool isAtRest(const aiVectorKey* keys, uint count, const aiVector3D& rest){
+	for(uint i=0; i<count; i++) if(!equalsFuzzy(float3::make(keys[i].mValue.x, keys[i].mValue.y, keys[i].mValue.z), float3::make(rest.x, rest.y, rest.z), STATIC_EPSILON)) return false;
+	return true;
+}
+bool isAtRest(const aiQuatKey* keys, uint count, const aiQuaternion& rest){
+	aiQuaternion neg(-rest.w, -rest.x, -rest.y, -rest.z);
+	for(uint i=0; i<count; i++) if(!equalsFuzzy(keys[i].mValue, rest, STATIC_EPSILON) && !equalsFuzzy(keys[i].mValue, neg, STATIC_EPSILON)) return false;
+	return true;
+}
+int THREADS = 0;
+/** The most threads -threads accepts. */
+const int MAX_THREADS = 1024;
+template<class Job> void runJobs(Job* job, size_t count, std::atomic<size_t>* next){
+	Arena arena; for(size_t i = (*next)++; i < count; i = (*next)++){(*job)(i, arena); arena.reset();}
+}
+/** Calls job(i, arena) for every i below count on THREADS threads (every hardware thread if 0). Each thread has its
+ * own arena, reset after every call. Jobs are handed out in order as threads become free, so a job must not depend
+ * on other jobs or on the thread it runs on, and must write its result to a slot of its own. */
+template<class Job> void parallelFor(size_t count, Job& job){
+	size_t n = THREADS > 0?THREADS:max(std::thread::hardware_concurrency(), 1u); if(n > count) n = count;
+	std::atomic<size_t> next(0); std::vector<std::thread> threads;
+	for(size_t t=1; t<n; t++) threads.push_back(std::thread(runJobs<Job>, &job, count, &next));
+	if(n > 0) runJobs(&job, count, &next);
+	for(size_t t=0; t<threads.size(); t++) threads[t].join();
+}
+
+/** A channel encoded by ChannelEncoder: its node, whether all of its tracks are at rest, and its bytes. */
+struct EncodedChannel {
+	int node; bool atRest; std::string data;
+};
+/** Encodes every channel of every animation of a scene on its own, so channels can be encoded in parallel. Constant
+ * tracks are reduced to one key by key reduction. With DROP_REST, tracks whose keys all equal their rest value are
+ * written with no keys, and channels whose tracks are all at rest are marked to be left out. */
+struct ChannelEncoder {
+	const aiScene* scene; const NodeMap* node_map; int baseAnim; std::vector<size_t> first; std::vector<EncodedChannel> channels;
+	ChannelEncoder(const aiScene* s, const NodeMap& map, int base) : scene(s), node_map(&map), baseAnim(base){
+		for(uint a=0; a<scene->mNumAnimations; a++){first.push_back(channels.size()); channels.resize(channels.size()+scene->mAnimations[a]->mNumChannels);}
+		first.push_back(channels.size());
+	}
+	void operator()(size_t job, Arena& arena){
+		uint a = 0; while(first[a+1] <= job) a++;
+		const aiNodeAnim* n = scene->mAnimations[a]->mChannels[job-first[a]]; EncodedChannel& out = channels[job];
+		NodeMap::const_iterator it = node_map->find(ArenaString(n->mNodeName.C_Str(), ArenaAllocator<char>(&arena)));
+		out.node = it == node_map->end()?-1:it->second; if(out.node < 0) return;
+		ChannelTracks t = getTracks(scene, n, arena, ADDITIVE_REFERENCE != NULL && (int)a != baseAnim, baseAnim >= 0?scene->mAnimations[baseAnim]:NULL);
+		int rest = !DROP_REST?0:(isAtRest(t.positions, t.numPositions, t.restPosition)?1:0)|(isAtRest(t.rotations, t.numRotations, t.restRotation)?2:0)|(isAtRest(t.scalings, t.numScalings, t.restScaling)?4:0);
+		out.atRest = rest == 7; if(out.atRest) return;
+		std::ostringstream file(std::ios::out | std::ios::binary); writeShort(file, out.node);
+		if(rest & 1) writeInt(file, 0); else writeVectorArray(file, t.positions, t.numPositions, arena);
+		if(rest & 2) writeInt(file, 0); else writeQuatArray(file, t.rotations, t.numRotations, arena);
+		if(rest & 4) writeInt(file, 0); else writeVectorArray(file, t.scalings, t.numScalings, arena);
+		out.data = file.str();
 	}
+};
+/** Writes an animation from its channels encoded by a ChannelEncoder, in the order of the animation's channels,
+ * so the output does not depend on how the channels were scheduled. */
+void loadAnimation(std::ostream& file, const aiAnimation* anim, const EncodedChannel* channels){
+	writeUTF(file, anim->mName); writeFloat(file, anim->mDuration); int numChannels = 0, numStatic = 0;
+	for(uint i=0; i<anim->mNumChannels; i++) if(channels[i].node >= 0){if(channels[i].atRest) numStatic++; else numChannels++;}
+	std::cout << "Animation: " << anim->mName.C_Str() << ", Channels: " << numChannels << ", Static: " << numStatic << std::endl;
+	writeInt(file, numChannels); for(uint i=0; i<anim->mNumChannels; i++) file << channels[i].data;
 }
 
-void writeMat4(std::ofstream& file, const aiMatrix4x4& mat){
+const char* CLIPS_FILE = NULL;
+/** A named time range of an animation, read from a -clips file. Times are in seconds. */
+struct ClipRange {std::string name; double start, end; uint anim;};
+/** Reads a -clips file: one clip per line, as its name, start time and end time in seconds, optionally followed by
+ * the name of the animation to take it from (the first animation by default). Blank lines and lines starting with
+ * # are ignored. Clips that end after their animation are kept, holding its last pose, with a warning. Returns false
+ * if the file could not be read, has an invalid line or has no clips. */
+bool readClips(const char* path, const aiScene* scene, std::vector<ClipRange>& clips){
+	MappedFile f; if(!f.open(path)){std::cout << "Error: Could not read " << path << std::endl; return false;}
+	std::istringstream in(std::string((const char*)f.getBytes(), (size_t)f.getSize())); std::string line, source;
+	for(int num=1; std::getline(in, line); num++){
+		std::istringstream ls(line); ClipRange c; c.anim = 0; if(!(ls >> c.name) || c.name[0] == '#') continue;
+		if(!(ls >> c.start >> c.end) || !(c.end >= c.start) || c.start < 0){std::cout << "Error: Invalid clip on line " << num << " of " << path << std::endl; return false;}
+		if(ls >> source){
+			for(c.anim=0; c.anim<scene->mNumAnimations && source != scene->mAnimations[c.anim]->mName.C_Str(); c.anim++);
+			if(c.anim == scene->mNumAnimations){std::cout << "Error: Unknown animation " << source << " on line " << num << " of " << path << std::endl; return false;}
+		} else if(scene->mNumAnimations == 0){std::cout << "Error: The scene has no animations to split into clips" << std::endl; return false;}
+		const aiAnimation* src = scene->mAnimations[c.anim]; double tps = src->mTicksPerSecond > 0?src->mTicksPerSecond:25;
+		if(c.end*tps > src->mDuration) std::cout << "Warning: Clip " << c.name << " ends at " << c.end << " s, after the end of animation " << src->mName.C_Str() << " at " << src->mDuration/tps << " s" << std::endl;
+		clips.push_back(c);
+	} if(clips.empty()){std::cout << "Error: " << path << " has no clips" << std::endl; return false;}
+	return true;
+}
+inline aiVector3D sampleKeys(const aiVectorKey* keys, uint count, double time){
+	uint i = 0; while(i+1 < count && keys[i+1].mTime <= time) i++;
+	if(i+1 == count || time <= keys[i].mTime) return keys[i].mValue;
+	return keys[i].mValue+(keys[i+1].mValue-keys[i].mValue)*(float)((time-keys[i].mTime)/(keys[i+1].mTime-keys[i].mTime));
+}
+inline aiQuaternion sampleKeys(const aiQuatKey* keys, uint count, double time){
+	uint i = 0; while(i+1 < count && keys[i+1].mTime <= time) i++;
+	if(i+1 == count || time <= keys[i].mTime) return keys[i].mValue;
+	aiQuaternion q; aiQuaternion::Interpolate(q, keys[i].mValue, keys[i+1].mValue, (float)((time-keys[i].mTime)/(keys[i+1].mTime-keys[i].mTime))); return q;
+}
+/** Returns the keys of a track between start and end, with their times rebased to start. Keys are interpolated
+ * at start and end, so the clip begins and ends exactly where the track was at those times. */
+template<class K> K* sliceKeys(const K* keys, uint count, double start, double end, uint& n){
+	K* out = new K[count+2]; n = 0; if(count == 0) return out;
+	out[n++] = K(0, sampleKeys(keys, count, start));
+	for(uint i=0; i<count; i++) if(keys[i].mTime > start && keys[i].mTime < end){out[n] = keys[i]; out[n++].mTime -= start;}
+	if(end > start) out[n++] = K(end-start, sampleKeys(keys, count, end));
+	return out;
+}
+/** Returns the index of the key of a stepped track (mesh or morph keys) that is active at a time. */
+template<class K> uint findActiveKey(const K* keys, uint count, double time){
+	uint i = 0; while(i+1 < count && keys[i+1].mTime <= time) i++; return i;
+}
+/** Replaces the animations of a scene with clips cut from them, as if the file had held the clips. Node tracks are
+ * interpolated at the start and end of each clip, and mesh and morph keys, which are stepped, start with the key
+ * active at the start of the clip. Key times are rebased so every clip starts at 0. */
+void splitClips(aiScene* scene, const std::vector<ClipRange>& clips){
+	aiAnimation** anims = new aiAnimation*[clips.size()];
+	for(size_t c=0; c<clips.size(); c++){
+		const ClipRange& r = clips[c]; const aiAnimation* src = scene->mAnimations[r.anim]; aiAnimation* anim = new aiAnimation(); anims[c] = anim;
+		double tps = src->mTicksPerSecond > 0?src->mTicksPerSecond:25, start = r.start*tps, end = r.end*tps;
+		anim->mName.Set(r.name); anim->mTicksPerSecond = src->mTicksPerSecond; anim->mDuration = end-start;
+		std::cout << "Clip: " << r.name << ", Animation: " << src->mName.C_Str() << ", Ticks: " << start << " - " << end << std::endl;
+		anim->mNumChannels = src->mNumChannels; anim->mChannels = new aiNodeAnim*[src->mNumChannels];
+		for(uint i=0; i<src->mNumChannels; i++){
+			const aiNodeAnim* s = src->mChannels[i]; aiNodeAnim* d = new aiNodeAnim(); anim->mChannels[i] = d;
+			d->mNodeName = s->mNodeName; d->mPreState = s->mPreState; d->mPostState = s->mPostState;
+			d->mPositionKeys = sliceKeys(s->mPositionKeys, s->mNumPositionKeys, start, end, d->mNumPositionKeys);
+			d->mRotationKeys = sliceKeys(s->mRotationKeys, s->mNumRotationKeys, start, end, d->mNumRotationKeys);
+			d->mScalingKeys = sliceKeys(s->mScalingKeys, s->mNumScalingKeys, start, end, d->mNumScalingKeys);
+		} anim->mNumMeshChannels = src->mNumMeshChannels; anim->mMeshChannels = new aiMeshAnim*[src->mNumMeshChannels];
+		for(uint i=0; i<src->mNumMeshChannels; i++){
+			const aiMeshAnim* s = src->mMeshChannels[i]; aiMeshAnim* d = new aiMeshAnim(); anim->mMeshChannels[i] = d;
+			d->mName = s->mName; d->mKeys = new aiMeshKey[s->mNumKeys]; d->mNumKeys = 0;
+			for(uint k=(s->mNumKeys > 0?findActiveKey(s->mKeys, s->mNumKeys, start):0); k<s->mNumKeys; k++){
+				if(d->mNumKeys > 0 && s->mKeys[k].mTime >= end) break;
+				aiMeshKey& key = d->mKeys[d->mNumKeys++]; key.mTime = max(s->mKeys[k].mTime-start, 0.0); key.mValue = s->mKeys[k].mValue;
+			}
+		} anim->mNumMorphMeshChannels = src->mNumMorphMeshChannels; anim->mMorphMeshChannels = new aiMeshMorphAnim*[src->mNumMorphMeshChannels];
+		for(uint i=0; i<src->mNumMorphMeshChannels; i++){
+			const aiMeshMorphAnim* s = src->mMorphMeshChannels[i]; aiMeshMorphAnim* d = new aiMeshMorphAnim(); anim->mMorphMeshChannels[i] = d;
+			d->mName = s->mName; d->mKeys = new aiMeshMorphKey[s->mNumKeys]; d->mNumKeys = 0;
+			for(uint k=(s->mNumKeys > 0?findActiveKey(s->mKeys, s->mNumKeys, start):0); k<s->mNumKeys; k++){
+				if(d->mNumKeys > 0 && s->mKeys[k].mTime >= end) break;
+				const aiMeshMorphKey& from = s->mKeys[k]; aiMeshMorphKey& key = d->mKeys[d->mNumKeys++]; uint nv = from.mNumValuesAndWeights;
+				key.mTime = max(from.mTime-start, 0.0); key.mNumValuesAndWeights = nv; key.mValues = new uint[nv]; key.mWeights = new double[nv];
+				for(uint v=0; v<nv; v++){key.mValues[v] = from.mValues[v]; key.mWeights[v] = from.mWeights[v];}
+			}
+		}
+	} for(uint i=0; i<scene->mNumAnimations; i++) delete scene->mAnimations[i];
+	delete[] scene->mAnimations; scene->mAnimations = anims; scene->mNumAnimations = (uint)clips.size();
+}
+
+void writeMat4(std::ostream& file, const aiMatrix4x4& mat){
 	float* ar = (float*)(&mat); for(int i=0; i<16; i++) writeFloat(file, ar[i]);
 }
-void loadScene(std::ofstream& file, const aiScene* scene){
-	int vcount = 0, icount = 0, voff = 0, ioff = 0; BoneData bones;
-	getVertexCount(scene, scene->mRootNode, vcount, icount, bones);
+bool DUAL_QUAT = false;
+/** Writes the inverse bind pose of every bone in bone id order as a dual quaternion with a uniform scale, the
+ * layout AnimSampler.h reads. Bind poses with a non-uniform scale use the average scale, with a warning. */
+void writeDualQuatBinds(std::ostream& file, const BoneData& bones, Arena& arena){
+	ArenaVector<BoneData::BoneMap::const_iterator>::type order(bones.bones.size(), bones.bones.end(), &arena);
+	for(BoneData::BoneMap::const_iterator i = bones.bones.begin(); i != bones.bones.end(); i++) if(i->second.id < order.size()) order[i->second.id] = i;
+	writeInt(file, order.size()); for(size_t b=0; b<order.size(); b++){
+		aiVector3D s(1, 1, 1), p; aiQuaternion r; if(order[b] != bones.bones.end()) order[b]->second.transform.Decompose(s, r, p);
+		float scale = (s.x+s.y+s.z)/3; if(abs(s.x-scale) > 0.001f*abs(scale) || abs(s.y-scale) > 0.001f*abs(scale) || abs(s.z-scale) > 0.001f*abs(scale))
+			std::cout << "Warning: Bone " << order[b]->first.c_str() << " has a non-uniform scale, its dual quaternion uses the average" << std::endl;
+		DualQuat d = DualQuat::make(float4::make(r.x, r.y, r.z, r.w), float3::make(p.x, p.y, p.z), scale);
+		for(int j=0; j<4; j++) writeFloat(file, d.real[j]);
+		for(int j=0; j<4; j++) writeFloat(file, d.dual[j]); writeFloat(file, d.scale);
+	}
+}
+float BAKE_RATE = 0;
+/** The highest frame rate palettes and vertex animations can be baked at, which bounds the size of the baked frames. */
+const double MAX_BAKE_RATE = 1000;
+/** Bakes the skinning palette of every animation at BAKE_RATE frames per second. The animations and node tree
+ * already written to animData are read back with WOBJFile and evaluated with AnimSampler, so the palettes match
+ * what the sampler computes at runtime. Each frame stores the top three rows of every bone's skinning matrix
+ * (12 floats, or 3 RGBA texels), so the frames of all animations together form a texture with 3 texels per bone
+ * per row and one row per frame. The section holds the bone count (int), the animation count (int), then for each
+ * animation its first row (int), frame count (int) and ticks per frame (float), followed by the rows. Additive
+ * animations are baked layered over their reference pose, the first frame of baseAnim or the bind pose if it is -1.
+ * Returns false if the animations could not be read back. */
+bool writePalettes(std::ostream& file, const aiScene* scene, short nAnim, const std::string& animData, int baseAnim){
+	std::ostringstream buffer(std::ios::out | std::ios::binary); writeInt(buffer, 0); writeInt(buffer, 0); writeShort(buffer, nAnim);
+	for(int i=0; i<6; i++) writeFloat(buffer, 0); buffer << animData; std::string bytes = buffer.str();
+	WOBJFile wobj; if(!wobj.read(bytes.data(), bytes.size())){std::cout << "Error: Could not read back animations to bake" << std::endl; return false;}
+	AnimSampler sampler(wobj); int nBones = sampler.getBoneCount(), row = 0; std::vector<Mat4> palette(nBones > 0?nBones:1);
+	std::ostringstream rows(std::ios::out | std::ios::binary); writeInt(file, nBones); writeInt(file, nAnim);
+	for(int a=0; a<nAnim; a++){
+		const aiAnimation* anim = scene->mAnimations[a]; float duration = wobj.animations[a].duration;
+		float step = (float)((anim->mTicksPerSecond > 0?anim->mTicksPerSecond:25)/BAKE_RATE);
+		int frames = (int)ceil(max(duration, 0.0f)/step)+1; writeInt(file, row); writeInt(file, frames); writeFloat(file, step); row += frames;
+		std::cout << "Palettes: " << anim->mName.C_Str() << ", Frames: " << frames << std::endl;
+		for(int f=0; f<frames; f++){
+			sampler.reset(); float t = min(f*step, duration);
+			if(ADDITIVE_REFERENCE == NULL || a == baseAnim) sampler.sample(a, t);
+			else {if(baseAnim >= 0) sampler.sample(baseAnim, 0); sampler.sampleAdditive(a, t);}
+			sampler.evaluate(); sampler.getPalette(&palette[0]);
+			for(int b=0; b<nBones; b++) for(int r=0; r<3; r++) for(int c=0; c<4; c++) writeFloat(rows, palette[b].m[c*4+r]);
+		}
+	} file << rows.str(); return true;
+}
+float VAT_RATE = 0;
+/** The largest width of a vertex animation texture. Vertex counts past it wrap onto more rows per frame. */
+const int MAX_VAT_WIDTH = 4096;
+/** The vertices of the merged vertex buffer generated from one node's reference to a mesh, and the transform
+ * they were generated with. */
+struct VertexRange {
+	const aiNode* node; uint mesh_id; longlong start; aiMatrix4x4 transform;
+};
+typedef ArenaVector<VertexRange>::type VertexRangeList;
+/** Collects the vertex range of every mesh reference, in the order generateMesh() generates them. */
+void getVertexRanges(const aiScene* scene, const aiNode* node, const aiMatrix4x4& transform, longlong& voff, VertexRangeList& ranges){
+	aiMatrix4x4 mat = transform*node->mTransformation;
+	for(uint i=0; i<node->mNumMeshes; i++){
+		const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+		if(mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || !mesh->HasPositions() || !mesh->HasFaces()) continue;
+		VertexRange r = {node, node->mMeshes[i], voff, mat}; ranges.push_back(r); voff += mesh->mNumVertices;
+	} for(uint i=0; i<node->mNumChildren; i++) getVertexRanges(scene, node->mChildren[i], mat, voff, ranges);
+}
+/** Returns true if a mesh or morph channel with the passed name animates a node's reference to a mesh. Channels
+ * are named after the mesh by some importers and after the node by others, so either matches. */
+inline bool animatesRange(const aiString& channel, const aiScene* scene, const VertexRange& r){
+	return channel == scene->mMeshes[r.mesh_id]->mName || channel == r.node->mName;
+}
+/** Evaluates the mesh and morph channels of an animation that animate a mesh reference at a time, writing the
+ * animated position and normal of each of the mesh's vertices, in the mesh's own space. Mesh channels switch
+ * between anim meshes at each key, and morph channels blend anim meshes by weights interpolated between keys.
+ * Returns false if no channel animates the reference. */
+bool evaluateMeshAnim(const aiScene* scene, const aiAnimation* anim, const VertexRange& r, double time, aiVector3D* pos, aiVector3D* norm){
+	const aiMesh* mesh = scene->mMeshes[r.mesh_id]; uint n = mesh->mNumVertices;
+	for(uint c=0; c<anim->mNumMeshChannels; c++){
+		const aiMeshAnim* ch = anim->mMeshChannels[c]; if(ch->mNumKeys == 0 || !animatesRange(ch->mName, scene, r)) continue;
+		uint k = 0; while(k+1 < ch->mNumKeys && ch->mKeys[k+1].mTime <= time) k++;
+		const aiAnimMesh* am = (ch->mKeys[k].mValue < mesh->mNumAnimMeshes)?mesh->mAnimMeshes[ch->mKeys[k].mValue]:NULL;
+		for(uint i=0; i<n; i++){
+			pos[i] = (am != NULL && am->HasPositions() && i < am->mNumVertices)?am->mVertices[i]:mesh->mVertices[i];
+			norm[i] = (am != NULL && am->HasNormals() && i < am->mNumVertices)?am->mNormals[i]:(mesh->HasNormals()?mesh->mNormals[i]:aiVector3D());
+		} return true;
+	} for(uint c=0; c<anim->mNumMorphMeshChannels; c++){
+		const aiMeshMorphAnim* ch = anim->mMorphMeshChannels[c]; if(ch->mNumKeys == 0 || !animatesRange(ch->mName, scene, r)) continue;
+		uint k = 0; while(k+1 < ch->mNumKeys && ch->mKeys[k+1].mTime <= time) k++;
+		const aiMeshMorphKey& a = ch->mKeys[k]; const aiMeshMorphKey& b = ch->mKeys[k+1 < ch->mNumKeys?k+1:k];
+		double f = (b.mTime > a.mTime)?clamp((time-a.mTime)/(b.mTime-a.mTime), 0.0, 1.0):0.0;
+		for(uint i=0; i<n; i++){pos[i] = mesh->mVertices[i]; norm[i] = mesh->HasNormals()?mesh->mNormals[i]:aiVector3D();}
+		for(int side=0; side<2; side++){
+			const aiMeshMorphKey& key = side?b:a; double keyWeight = side?f:1-f; if(keyWeight == 0) continue;
+			for(uint j=0; j<key.mNumValuesAndWeights; j++){
+				if(key.mValues[j] >= mesh->mNumAnimMeshes) continue;
+				const aiAnimMesh* am = mesh->mAnimMeshes[key.mValues[j]]; float w = (float)(key.mWeights[j]*keyWeight);
+				for(uint i=0; i<n && i<am->mNumVertices; i++){
+					if(am->HasPositions()) pos[i] += (am->mVertices[i]-mesh->mVertices[i])*w;
+					if(am->HasNormals() && mesh->HasNormals()) norm[i] += (am->mNormals[i]-mesh->mNormals[i])*w;
+				}
+			}
+		} return true;
+	} return false;
+}
+/** Writes one channel of a vertex animation texture texel, quantized to unorm16 between the passed bounds. Values
+ * that are not finite are written as 0, since converting them to an integer is undefined. */
+void writeUnorm16(std::ostream& file, float v, float lo, float hi){
+	float t = hi > lo?(v-lo)/(hi-lo):0; writeShort(file, (short)(ushort)(t >= 0?min(t, 1.0f)*65535+0.5f:0));
+}
+/** Bakes the mesh and morph animations of a scene into vertex animation textures at VAT_RATE frames per second.
+ * Every frame stores the difference between the animated and generated position and normal of every vertex of
+ * the merged vertex buffer, in vertex order, so a shader can fetch them by vertex index. Deltas are quantized to
+ * unorm16 between the bounds of each clip's deltas. The section holds the vertex count (int), the texture width
+ * (int), the rows per frame (int) and the clip count (int), then for each clip its name, animation index (int),
+ * first row (int), frame count (int), ticks per frame (float), position delta bounds and normal delta bounds
+ * (6 floats each), followed by the position texture and the normal texture, each an RGBA16 texel per vertex with
+ * the delta in RGB. Only animations with mesh or morph channels become clips. */
+void writeVertexAnimations(std::ostream& file, const aiScene* scene, longlong vcount, Arena& arena){
+	longlong voff = 0; aiMatrix4x4 identity(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1); VertexRangeList ranges(&arena);
+	getVertexRanges(scene, scene->mRootNode, identity, voff, ranges);
+	int width = (int)min(vcount, (longlong)MAX_VAT_WIDTH), rowsPerFrame = width > 0?(int)((vcount+width-1)/width):0;
+	std::ostringstream positions(std::ios::out | std::ios::binary), normals(std::ios::out | std::ios::binary), clips(std::ios::out | std::ios::binary);
+	uint maxVerts = 0; for(uint m=0; m<scene->mNumMeshes; m++) maxVerts = max(maxVerts, scene->mMeshes[m]->mNumVertices);
+	ArenaVector<aiVector3D>::type pos(maxVerts, aiVector3D(), &arena), norm(maxVerts, aiVector3D(), &arena);
+	ArenaVector<float3>::type dpos(vcount, float3::make(0, 0, 0), &arena), dnorm(vcount, float3::make(0, 0, 0), &arena);
+	int nClips = 0, row = 0; for(uint a=0; a<scene->mNumAnimations; a++){
+		const aiAnimation* anim = scene->mAnimations[a]; if(anim->mNumMeshChannels == 0 && anim->mNumMorphMeshChannels == 0) continue;
+		double step = (anim->mTicksPerSecond > 0?anim->mTicksPerSecond:25)/VAT_RATE; int frames = (int)ceil(max(anim->mDuration, 0.0)/step)+1;
+		BBox3D<float> pbounds, nbounds; std::fill(dpos.begin(), dpos.end(), float3::make(0, 0, 0)); std::fill(dnorm.begin(), dnorm.end(), float3::make(0, 0, 0));
+		// the first pass finds the clip's delta bounds, and the second quantizes the deltas
+		for(int pass=0; pass<2; pass++) for(int f=0; f<frames; f++){
+			double time = min(f*step, anim->mDuration);
+			for(size_t i=0; i<ranges.size(); i++){
+				const VertexRange& r = ranges[i]; const aiMesh* mesh = scene->mMeshes[r.mesh_id];
+				if(!evaluateMeshAnim(scene, anim, r, time, &pos[0], &norm[0])) continue;
+				aiMatrix3x3 normalMat = aiMatrix3x3(r.transform); normalMat.Inverse(); normalMat.Transpose();
+				for(uint v=0; v<mesh->mNumVertices; v++){
+					const aiVector3D& b = mesh->mVertices[v]; float4 p = mul(r.transform, float4::make(pos[v].x, pos[v].y, pos[v].z, 1)), p0 = mul(r.transform, float4::make(b.x, b.y, b.z, 1));
+					dpos[r.start+v] = float3::make(p.x-p0.x, p.y-p0.y, p.z-p0.z);
+					if(!mesh->HasNormals()) continue;
+					float3 n = mul(normalMat, float3::make(norm[v].x, norm[v].y, norm[v].z)), n0 = mul(normalMat, float3::make(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z));
+					// a zero generated normal has no direction to change from, so it gets no delta
+					if(length(n0) > 0){if(length(n) > 0) normalize_m(n); normalize_m(n0); dnorm[r.start+v] = n-n0;} else dnorm[r.start+v] = float3::make(0, 0, 0);
+				}
+			} for(longlong v=0; v<(longlong)width*rowsPerFrame; v++){
+				float3 dp = (v < vcount)?dpos[v]:float3::make(0, 0, 0), dn = (v < vcount)?dnorm[v]:float3::make(0, 0, 0);
+				if(pass == 0){if(v < vcount){pbounds += dp; nbounds += dn;} continue;}
+				for(int c=0; c<3; c++) writeUnorm16(positions, dp[c], pbounds.botLeft[c], pbounds.topRight[c]); writeShort(positions, -1);
+				for(int c=0; c<3; c++) writeUnorm16(normals, dn[c], nbounds.botLeft[c], nbounds.topRight[c]); writeShort(normals, -1);
+			}
+		} std::cout << "Vertex animation: " << anim->mName.C_Str() << ", Frames: " << frames << std::endl;
+		writeUTF(clips, anim->mName); writeInt(clips, a); writeInt(clips, row); writeInt(clips, frames); writeFloat(clips, (float)step);
+		writeFloat(clips, pbounds.botLeft.x); writeFloat(clips, pbounds.botLeft.y); writeFloat(clips, pbounds.botLeft.z);
+		writeFloat(clips, pbounds.topRight.x); writeFloat(clips, pbounds.topRight.y); writeFloat(clips, pbounds.topRight.z);
+		writeFloat(clips, nbounds.botLeft.x); writeFloat(clips, nbounds.botLeft.y); writeFloat(clips, nbounds.botLeft.z);
+		writeFloat(clips, nbounds.topRight.x); writeFloat(clips, nbounds.topRight.y); writeFloat(clips, nbounds.topRight.z);
+		row += frames*rowsPerFrame; nClips++;
+	} writeInt(file, (int)vcount); writeInt(file, width); writeInt(file, rowsPerFrame); writeInt(file, nClips);
+	file << clips.str() << positions.str() << normals.str();
+}
+bool MORPH_TARGETS = false; float MORPH_EPSILON = 0.0001f;
+void writeHalf(std::ostream& file, float f){half_float h(f); writeShort(file, (short)h.value.binary);}
+/** Writes the blend shapes (anim meshes) of every mesh reference as sparse targets, followed by the weight curves
+ * of every animation's morph channels. A target only lists the vertices it moves: those whose position or normal
+ * changes by more than MORPH_EPSILON once transformed like the generated vertices. The section holds the target
+ * count (int), then for each target its name and entry count (int) followed by each entry's vertex index in the
+ * merged vertex buffer (int), position delta and normal delta (3 half floats each). Then it holds the clip count
+ * (int), and for each animation with morph channels its name, animation index (int) and curve count (int), followed
+ * by each curve's target (int), key count (int) and keys (time and weight floats). Curves that stay at zero are
+ * left out. */
+void writeMorphTargets(std::ostream& file, const aiScene* scene, Arena& arena){
+	longlong voff = 0; aiMatrix4x4 identity(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1); VertexRangeList ranges(&arena);
+	getVertexRanges(scene, scene->mRootNode, identity, voff, ranges);
+	ArenaVector<int>::type firstTarget(ranges.size()+1, 0, &arena); int nTargets = 0; longlong nEntries = 0;
+	std::ostringstream targets(std::ios::out | std::ios::binary);
+	for(size_t i=0; i<ranges.size(); i++){
+		const VertexRange& r = ranges[i]; const aiMesh* mesh = scene->mMeshes[r.mesh_id]; firstTarget[i] = nTargets;
+		aiMatrix3x3 normalMat = aiMatrix3x3(r.transform); normalMat.Inverse(); normalMat.Transpose();
+		for(uint t=0; t<mesh->mNumAnimMeshes; t++){
+			const aiAnimMesh* am = mesh->mAnimMeshes[t]; aiString name = am->mName;
+			if(name.length == 0){std::ostringstream n; n << mesh->mName.C_Str() << "_" << t; name.Set(n.str());}
+			std::ostringstream entries(std::ios::out | std::ios::binary); int count = 0;
+			for(uint v=0; v<mesh->mNumVertices && v<am->mNumVertices; v++){
+				float3 dp = float3::make(0, 0, 0), dn = float3::make(0, 0, 0);
+				if(am->HasPositions()){
+					aiVector3D d = am->mVertices[v]-mesh->mVertices[v]; float4 p = mul(r.transform, float4::make(d.x, d.y, d.z, 0));
+					dp = float3::make(p.x, p.y, p.z);
+				} if(am->HasNormals() && mesh->HasNormals()){
+					float3 n = mul(normalMat, float3::make(am->mNormals[v].x, am->mNormals[v].y, am->mNormals[v].z));
+					float3 n0 = mul(normalMat, float3::make(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z));
+					if(length(n0) > 0){if(length(n) > 0) normalize_m(n); normalize_m(n0); dn = n-n0;}
+				} if(max(max(abs(dp.x), abs(dp.y)), abs(dp.z)) <= MORPH_EPSILON && max(max(abs(dn.x), abs(dn.y)), abs(dn.z)) <= MORPH_EPSILON) continue;
+				writeInt(entries, (int)(r.start+v)); for(int c=0; c<3; c++) writeHalf(entries, dp[c]);
+				for(int c=0; c<3; c++) writeHalf(entries, dn[c]); count++;
+			} writeUTF(targets, name); writeInt(targets, count); targets << entries.str(); nTargets++; nEntries += count;
+			std::cout << "Morph target: " << name.C_Str() << ", Vertices: " << count << " of " << mesh->mNumVertices << std::endl;
+		}
+	} firstTarget[ranges.size()] = nTargets; writeInt(file, nTargets); file << targets.str();
+	std::ostringstream clips(std::ios::out | std::ios::binary); int nClips = 0;
+	for(uint a=0; a<scene->mNumAnimations; a++){
+		const aiAnimation* anim = scene->mAnimations[a]; if(anim->mNumMorphMeshChannels == 0) continue;
+		std::ostringstream curves(std::ios::out | std::ios::binary); int nCurves = 0;
+		for(uint c=0; c<anim->mNumMorphMeshChannels; c++){
+			const aiMeshMorphAnim* ch = anim->mMorphMeshChannels[c];
+			for(size_t i=0; i<ranges.size(); i++){
+				if(!animatesRange(ch->mName, scene, ranges[i])) continue;
+				for(int t=firstTarget[i]; t<firstTarget[i+1]; t++){
+					ArenaVector<float>::type keys(&arena); bool used = false;
+					for(uint k=0; k<ch->mNumKeys; k++){
+						const aiMeshMorphKey& key = ch->mKeys[k]; float w = 0;
+						for(uint j=0; j<key.mNumValuesAndWeights; j++) if((int)key.mValues[j] == t-firstTarget[i]) w += (float)key.mWeights[j];
+						keys.push_back((float)key.mTime); keys.push_back(w); if(w != 0) used = true;
+					} if(!used) continue;
+					writeInt(curves, t); writeInt(curves, ch->mNumKeys); for(size_t k=0; k<keys.size(); k++) writeFloat(curves, keys[k]); nCurves++;
+				}
+			}
+		} writeUTF(clips, anim->mName); writeInt(clips, a); writeInt(clips, nCurves); clips << curves.str(); nClips++;
+	} writeInt(file, nClips); file << clips.str();
+	std::cout << "Morph targets: " << nTargets << ", Entries: " << nEntries << ", Clips: " << nClips << std::endl;
+}
+bool LARGE_OUTPUT = false;
+/** Checks that the merged scene's sizes can be represented in the output before anything is written, so huge scenes
+ * fail with an error instead of overflowing. Large outputs store 64-bit counts and offsets, other outputs 32-bit ones. */
+bool checkOutputSize(longlong vcount, longlong icount, ulonglong total){
+	if(vcount > (longlong)uint_max+1){
+		std::cout << "Error: " << vcount << " vertices cannot be addressed by 32-bit indices" << std::endl; return false;
+	} if(!LARGE_OUTPUT && total > (ulonglong)MAX_VALUE(int)){
+		std::cout << "Error: " << total << " bytes of vertex and index data need 64-bit sizes, use -large" << std::endl; return false;
+	} if(total > (ulonglong)MAX_VALUE(ptr_diff_t)){
+		std::cout << "Error: " << total << " bytes of output cannot be mapped by a 32-bit build" << std::endl; return false;
+	} return true;
+}
+/** Writes the counts at the start of a WOBJ body, using the large variant's 64-bit counts if -large was passed. */
+void writeHeader(std::ostream& file, longlong vcount, longlong icount, short nAnim){
+	if(LARGE_OUTPUT){writeInt(file, -1); writeLong(file, vcount); writeLong(file, icount);}
+	else {writeInt(file, (int)vcount); writeInt(file, (int)icount);}
+	writeShort(file, nAnim);
+}
+void writeBounds(std::ostream& file, const BBox3D<double>& bounds){
+	writeFloat(file, bounds.botLeft.x); writeFloat(file, bounds.botLeft.y); writeFloat(file, bounds.botLeft.z);
+	writeFloat(file, bounds.topRight.x); writeFloat(file, bounds.topRight.y); writeFloat(file, bounds.topRight.z);
+}
+
+/** Writes an optional section: a FOURCC tag, the size of its data in bytes and the data. Sections are appended after
+ * the end of a WOBJ file, behind WOBJ_SECTIONS_MAGIC, so they follow everything an older reader expects, and readers
+ * skip sections with tags they do not know. */
+void writeSection(std::ostream& file, int tag, const std::string& data){
+	writeInt(file, tag); writeInt(file, (int)data.size()); file.write(data.data(), data.size());
+}
+
+bool INSTANCE_MESHES = false;
+/** A node's reference to a mesh, with the node's absolute transform. The slot groups references: with -instance
+ * it is the order the mesh was first referenced in, and with -materials it is the mesh's material. */
+struct MeshInstance {
+	int slot; uint mesh_id; const aiNode* node; aiMatrix4x4 transform;
+};
+typedef ArenaVector<MeshInstance>::type InstanceList;
+/** Groups instances by slot, keeping the nodes of each mesh in the order they were found. Every slot must be less
+ * than nslots. */
+void sortInstances(const InstanceList& instances, int nslots, InstanceList& sorted, Arena& arena){
+	ArenaVector<size_t>::type next(nslots+1, 0, &arena); sorted.resize(instances.size());
+	for(size_t i=0; i<instances.size(); i++) next[instances[i].slot+1]++;
+	for(int i=0; i<nslots; i++) next[i+1] += next[i];
+	for(size_t i=0; i<instances.size(); i++) sorted[next[instances[i].slot]++] = instances[i];
+}
+/** Collects every node's reference to a mesh, and counts the vertices and indices of each mesh once no matter how
+ * many nodes reference it. slots maps mesh ids to slots, and must start as -1 for every mesh. */
+void getInstances(const aiScene* scene, const aiNode* node, const aiMatrix4x4& transform, InstanceList& instances, ArenaVector<int>::type& slots, int& nslots, longlong& vcount, longlong& icount){
+	aiMatrix4x4 mat = transform*node->mTransformation;
+	for(uint i=0; i<node->mNumMeshes; i++){
+		uint mesh_id = node->mMeshes[i]; const aiMesh* mesh = scene->mMeshes[mesh_id];
+		if(mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || !mesh->HasPositions() || !mesh->HasFaces()) continue;
+		if(slots[mesh_id] < 0){
+			slots[mesh_id] = nslots++; meshes.push_back(MeshSubset(mesh->mName, icount, icount+(longlong)mesh->mNumFaces*3));
+			vcount += mesh->mNumVertices; icount += (longlong)mesh->mNumFaces*3;
+		} MeshInstance inst = {slots[mesh_id], mesh_id, node, mat}; instances.push_back(inst);
+	} for(uint i=0; i<node->mNumChildren; i++) getInstances(scene, node->mChildren[i], mat, instances, slots, nslots, vcount, icount);
+}
+/** Expands bounds to contain a box after it is transformed by the passed matrix. */
+void addTransformed(BBox3D<double>& bounds, const BBox3D<double>& box, const aiMatrix4x4& transform){
+	for(int c=0; c<8; c++){
+		float4 p = mul(transform, float4::make((c&1)?box.topRight.x:box.botLeft.x, (c&2)?box.topRight.y:box.botLeft.y, (c&4)?box.topRight.z:box.botLeft.z, 1));
+		bounds += double3::make(p.x, p.y, p.z);
+	}
+}
+/** Generates each mesh referenced by the passed instances once, in its own local space, and writes the instance
+ * table. For each mesh, the table holds its name, index range, local bounds and the absolute transform of every
+ * node that references it, so it can be drawn with one instanced draw. The scene bounds are expanded by the
+ * transformed local bounds of every instance. Instances must be sorted by slot. */
+void generateInstances(const aiScene* scene, const InstanceList& instances, VertexBuffer& vertices, IndexBuffer& indices, longlong& voff, longlong& ioff, BBox3D<double>& bounds, BoneData& bones, MeshStreamer* stream, std::ostream& table){
+	size_t n = instances.size(); int index = 0; aiMatrix4x4 local; writeInt(table, n == 0?0:instances[n-1].slot+1);
+	for(size_t i=0, end; i<n; i=end){
+		const MeshInstance& m = instances[i]; for(end = i; end < n && instances[end].slot == m.slot; end++);
+		longlong vfrom = voff, ifrom = ioff; BBox3D<double> box; writeUTF(table, scene->mMeshes[m.mesh_id]->mName);
+		std::cout << "Mesh: " << scene->mMeshes[m.mesh_id]->mName.C_Str() << ", Instances: " << end-i << std::endl;
+		loadMesh(scene, m.mesh_id, index, scene->mMeshes[m.mesh_id]->mName, local, vertices, indices, voff, ioff, box, bones);
+		if(stream != NULL) stream->meshDone(m.mesh_id, vfrom, voff, ifrom, ioff);
+		if(LARGE_OUTPUT){writeLong(table, ifrom); writeLong(table, ioff-ifrom);} else {writeInt(table, (int)ifrom); writeInt(table, (int)(ioff-ifrom));}
+		writeBounds(table, box); writeInt(table, (int)(end-i));
+		for(size_t j=i; j<end; j++){writeMat4(table, instances[j].transform); addTransformed(bounds, box, instances[j].transform);}
+	}
+}
+
+bool GROUP_MATERIALS = false;
+/** Collects every node's reference to a mesh with the node's absolute transform, using the mesh's material as
+ * the slot, and counts the vertices and indices of the meshes. */
+void getMaterialRefs(const aiScene* scene, const aiNode* node, const aiMatrix4x4& transform, InstanceList& refs, longlong& vcount, longlong& icount){
+	aiMatrix4x4 mat = transform*node->mTransformation;
+	for(uint i=0; i<node->mNumMeshes; i++){
+		uint mesh_id = node->mMeshes[i]; const aiMesh* mesh = scene->mMeshes[mesh_id];
+		if(mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || !mesh->HasPositions() || !mesh->HasFaces()) continue;
+		vcount += mesh->mNumVertices; icount += (longlong)mesh->mNumFaces*3;
+		MeshInstance ref = {(int)mesh->mMaterialIndex, mesh_id, node, mat}; refs.push_back(ref);
+	} for(uint i=0; i<node->mNumChildren; i++) getMaterialRefs(scene, node->mChildren[i], mat, refs, vcount, icount);
+}
+/** Generates the meshes referenced by nodes grouped by material, so the triangles of each material are one range
+ * of the index buffer, and writes the draw range table. For each material used, the table holds its index and name,
+ * the index start and count of its range, and the bounds of its triangles. References must be sorted by material. */
+void generateMaterials(const aiScene* scene, const InstanceList& refs, int& index, VertexBuffer& vertices, IndexBuffer& indices, longlong& voff, longlong& ioff, BBox3D<double>& bounds, BoneData& bones, MeshStreamer* stream, std::ostream& table){
+	size_t n = refs.size(); int nRanges = 0; for(size_t i=0; i<n; i++) if(i == 0 || refs[i].slot != refs[i-1].slot) nRanges++;
+	writeInt(table, nRanges); for(size_t i=0, end; i<n; i=end){
+		int material = refs[i].slot; longlong ifrom = ioff; BBox3D<double> box; aiString name;
+		scene->mMaterials[material]->Get(AI_MATKEY_NAME, name);
+		for(end = i; end < n && refs[end].slot == material; end++){
+			const MeshInstance& r = refs[end]; const aiMesh* mesh = scene->mMeshes[r.mesh_id]; longlong vstart = voff, istart = ioff;
+			meshes.push_back(MeshSubset(mesh->mName, ioff, ioff+(longlong)mesh->mNumFaces*3));
+			loadMesh(scene, r.mesh_id, index, r.node->mName, r.transform, vertices, indices, voff, ioff, box, bones);
+			if(stream != NULL) stream->meshDone(r.mesh_id, vstart, voff, istart, ioff);
+		} std::cout << "Material: " << name.C_Str() << ", Meshes: " << end-i << ", Indices: " << ioff-ifrom << std::endl;
+		writeInt(table, material); writeUTF(table, name);
+		if(LARGE_OUTPUT){writeLong(table, ifrom); writeLong(table, ioff-ifrom);} else {writeInt(table, (int)ifrom); writeInt(table, (int)(ioff-ifrom));}
+		writeBounds(table, box); bounds += box;
+	}
+}
+
+float TILE_SIZE = 0;
+/** The largest tile coordinate along each axis, so the three coordinates of a tile pack into one 64-bit key. */
+const int MAX_TILE_COORD = (1 << 20)-1;
+typedef std::map<longlong, int, std::less<longlong>, ArenaAllocator<std::pair<const longlong, int> > > TileMap;
+/** Returns the coordinate of the tile containing the passed position along one axis, or false if it is out of range. */
+bool getTileCoord(double pos, int& coord){
+	double c = floor(pos/TILE_SIZE); if(!(c >= -MAX_TILE_COORD && c <= MAX_TILE_COORD)) return false;
+	coord = (int)c; return true;
+}
+inline longlong getTileKey(int x, int y, int z){
+	return ((longlong)(z+MAX_TILE_COORD) << 42)|((longlong)(y+MAX_TILE_COORD) << 21)|(longlong)(x+MAX_TILE_COORD);
+}
+inline int getTileX(longlong key){return (int)(key&0x1FFFFF)-MAX_TILE_COORD;}
+inline int getTileY(longlong key){return (int)((key >> 21)&0x1FFFFF)-MAX_TILE_COORD;}
+inline int getTileZ(longlong key){return (int)(key >> 42)-MAX_TILE_COORD;}
+/** Splits merged static geometry into a grid of cubic tiles TILE_SIZE wide, aligned to the origin, and writes them
+ * as a tile file. Each triangle goes to the tile containing its centroid, so triangles are never split, and a tile's
+ * bounds can extend past its cell. The file starts with the WTIL magic, the tile count and the tile size, followed
+ * by an index of every tile (its grid coordinates, bounds, and the 64-bit offset and size of its chunk), and then
+ * the chunks. Each chunk is laid out exactly like a static WOBJ file, so it can be loaded on its own. Tiles are
+ * ordered by z, then y, then x coordinate. */
+bool writeTiles(const char* out, const VertexFormat& format, const VertexBuffer& vertices, const IndexBuffer& indices, Arena& arena){
+	longlong ntri = indices.getIndexCount()/3; int bpv = format.getBytesPerVertex();
+	ArenaVector<longlong>::type keys(&arena); keys.reserve(ntri); TileMap tileMap((std::less<longlong>()), TileMap::allocator_type(&arena));
+	for(longlong t=0; t<ntri; t++){
+		double3 c = double3::make(0, 0, 0); for(int i=0; i<3; i++){
+			float4 p = vertices.get(indices.get(t*3+i), POSITION); c.x += p.x; c.y += p.y; c.z += p.z;
+		} int x, y, z; if(!getTileCoord(c.x/3, x) || !getTileCoord(c.y/3, y) || !getTileCoord(c.z/3, z)){
+			std::cout << "Error: Tile size " << TILE_SIZE << " is too small for the scene" << std::endl; return false;
+		} longlong key = getTileKey(x, y, z); keys.push_back(key); tileMap[key] = 0;
+	} int ntiles = 0; for(TileMap::iterator i = tileMap.begin(); i != tileMap.end(); i++) i->second = ntiles++;
+	ArenaVector<longlong>::type first(ntiles+1, 0, &arena), order(ntri, 0, &arena);
+	for(longlong t=0; t<ntri; t++) first[tileMap[keys[t]]+1]++;
+	for(int i=0; i<ntiles; i++) first[i+1] += first[i];
+	ArenaVector<longlong>::type next(first.begin(), first.end()-1, &arena);
+	for(longlong t=0; t<ntri; t++) order[next[tileMap[keys[t]]]++] = t;
+
+	ulonglong isize = 12+(ulonglong)ntiles*52, offset = isize; MappedOutputFile output; if(!output.open(out, isize)) return false;
+	std::ostringstream index(std::ios::out | std::ios::binary);
+	writeInt(index, FOURCC('W','T','I','L')); writeInt(index, ntiles); writeFloat(index, TILE_SIZE);
+	ArenaVector<longlong>::type remap(vertices.getVertexCount(), -1, &arena), used(&arena);
+	TileMap::const_iterator tile = tileMap.begin(); for(int i=0; i<ntiles; i++, tile++){
+		used.clear(); for(longlong t=first[i]; t<first[i+1]; t++) for(int j=0; j<3; j++){
+			uint v = indices.get(order[t]*3+j); if(remap[v] < 0){remap[v] = used.size(); used.push_back(v);}
+		} longlong vcount = used.size(), icount = (first[i+1]-first[i])*3;
+		IndexFormat iformat(vcount); IndexBuffer tindices(&iformat, icount); BBox3D<double> bounds;
+		for(longlong t=first[i]; t<first[i+1]; t++) for(int j=0; j<3; j++) tindices.set((t-first[i])*3+j, (uint)remap[indices.get(order[t]*3+j)]);
+		std::ostringstream chunk(std::ios::out | std::ios::binary); writeHeader(chunk, vcount, icount, 0);
+		for(longlong v=0; v<vcount; v++){
+			float4 p = vertices.get(used[v], POSITION); bounds += double3::make(p.x, p.y, p.z);
+			chunk.write((const char*)bufferOffset(vertices.getBytes(), (ptr_diff_t)used[v]*bpv), bpv); remap[used[v]] = -1;
+		} chunk.write((const char*)tindices.getBytes(), (std::streamsize)tindices.getSize()); writeBounds(chunk, bounds);
+		std::string bytes = chunk.str(); if(!checkOutputSize(vcount, icount, bytes.size()) || !output.append(bytes.data(), bytes.size())) return false;
+		std::cout << "Tile: [" << getTileX(tile->first) << "," << getTileY(tile->first) << "," << getTileZ(tile->first) << "], Vertices: " << vcount << ", Indices: " << icount << std::endl;
+		writeInt(index, getTileX(tile->first)); writeInt(index, getTileY(tile->first)); writeInt(index, getTileZ(tile->first));
+		writeBounds(index, bounds); writeLong(index, offset); writeLong(index, bytes.size()); offset += bytes.size();
+	} memcpy(output.getBytes(), index.str().data(), (size_t)isize); return output.close();
+}
+/** Converts a static scene into a tile file. The merged scene is generated in memory and then split by writeTiles(). */
+bool convertTiles(const char* out, const aiScene* scene, const VertexFormat& format, longlong vcount, longlong icount, BoneData& bones, Arena& arena){
+	if(scene->HasAnimations()){std::cout << "Error: -tiles only supports static scenes" << std::endl; return false;}
+	if(vcount > (longlong)uint_max+1){std::cout << "Error: " << vcount << " vertices cannot be addressed by 32-bit indices" << std::endl; return false;}
+	IndexFormat iformat(vcount); VertexBuffer vertices(&format, vcount); IndexBuffer indices(&iformat, icount);
+	longlong voff = 0, ioff = 0; int index = 0; BBox3D<double> bounds; aiMatrix4x4 identity(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1);
+	generateMesh(scene, scene->mRootNode, index, identity, vertices, indices, voff, ioff, bounds, bones, NULL);
+	std::cout << "Bounds: [" << bounds.botLeft.x << "," << bounds.botLeft.y << "," << bounds.botLeft.z  << "] - [" << bounds.topRight.x << "," << bounds.topRight.y << "," << bounds.topRight.z << "]" << std::endl;
+	return writeTiles(out, format, vertices, indices, arena);
+}
+bool TIME_STEPS = false;
+/** With -timesteps, prints the time of the stage of the conversion that just finished and starts timing the next. */
+inline void endStage(Stopwatch& watch, const char* stage){
+	double ms = watch.lap(); if(TIME_STEPS) std::cout << "Stage: " << stage << " " << ms << " ms" << std::endl;
+}
+bool convertScene(const char* out, aiScene* scene, Arena& arena){
+	Stopwatch watch;
+	longlong vcount = 0, icount = 0, voff = 0, ioff = 0; BoneData bones(arena); aiMatrix4x4 identity(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1);
+	InstanceList instances(&arena); if(INSTANCE_MESHES){
+		if(scene->HasAnimations()){std::cout << "Error: -instance only supports static scenes" << std::endl; return false;}
+		ArenaVector<int>::type slots(scene->mNumMeshes, -1, &arena); int nslots = 0; InstanceList found(&arena);
+		getInstances(scene, scene->mRootNode, identity, found, slots, nslots, vcount, icount); sortInstances(found, nslots, instances, arena);
+	} else if(GROUP_MATERIALS){
+		InstanceList found(&arena); getMaterialRefs(scene, scene->mRootNode, identity, found, vcount, icount);
+		for(size_t i=0; i<found.size(); i++) if((uint)found[i].slot >= scene->mNumMaterials){
+			std::cout << "Error: Mesh " << scene->mMeshes[found[i].mesh_id]->mName.C_Str() << " references material " << (uint)found[i].slot << ", the scene has " << scene->mNumMaterials << std::endl; return false;
+		} sortInstances(found, scene->mNumMaterials, instances, arena);
+	} else getVertexCount(scene, scene->mRootNode, vcount, icount, bones);
 	VertexFormat format; format.addAttribute<float, 3, false>();
 	format.addAttribute<float, 3, false>(); format.addAttribute<float, 2, false>();
 	short nAnim = scene->HasAnimations()?(short)scene->mNumAnimations:0;
 	if(nAnim > 0){format.addAttribute<float, 4, false>(); format.addAttribute<float, 4, false>();}
-	VertexBuffer vertices(&format, vcount); IndexFormat iformat(vcount); IndexBuffer indices(&iformat, icount);
-	int index = 0; BBox3D<double> bounds; aiMatrix4x4 identity(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1);
-	generateMesh(scene, scene->mRootNode, index, identity, vertices, indices, voff, ioff, bounds, bones);
+	int baseAnim = -1; if(ADDITIVE_REFERENCE != NULL && strcmp(ADDITIVE_REFERENCE, "bind") != 0){
+		for(int i=0; i<nAnim && baseAnim < 0; i++) if(strcmp(scene->mAnimations[i]->mName.C_Str(), ADDITIVE_REFERENCE) == 0) baseAnim = i;
+		if(baseAnim < 0){std::cout << "Error: Unknown base animation " << ADDITIVE_REFERENCE << std::endl; return false;}
+	} if(nAnim > 0 && ROOT_MOTION_NODE != NULL && findNode(scene->mRootNode, aiString(std::string(ROOT_MOTION_NODE))) == NULL){
+		std::cout << "Error: Unknown root motion node " << ROOT_MOTION_NODE << std::endl; return false;
+	}
+	if(TILE_SIZE > 0) return convertTiles(out, scene, format, vcount, icount, bones, arena);
+	IndexFormat iformat(vcount); ulonglong vsize = VertexBuffer::getSize(&format, vcount), isize = IndexBuffer::getSize(&iformat, icount);
+	std::ostringstream header(std::ios::out | std::ios::binary); writeHeader(header, vcount, icount, nAnim); ulonglong hsize = header.str().size();
+	if(!checkOutputSize(vcount, icount, hsize+vsize+isize+24)) return false;
+	MappedOutputFile output; if(!output.open(out, hsize+vsize+isize+24)) return false;
+	memcpy(output.getBytes(), header.str().data(), (size_t)hsize);
+	VertexBuffer vertices(&format, vcount, bufferOffset(output.getBytes(), hsize)); IndexBuffer indices(&iformat, icount, bufferOffset(output.getBytes(), hsize+vsize));
+	int index = 0; BBox3D<double> bounds; std::ostringstream table(std::ios::out | std::ios::binary);
+	MeshStreamer* stream = STREAM_MESHES?new MeshStreamer(scene, &output, hsize, format.getBytesPerVertex(), hsize+vsize, iformat.getBytesPerIndex(), INSTANCE_MESHES):NULL;
+	if(INSTANCE_MESHES) generateInstances(scene, instances, vertices, indices, voff, ioff, bounds, bones, stream, table);
+	else if(GROUP_MATERIALS) generateMaterials(scene, instances, index, vertices, indices, voff, ioff, bounds, bones, stream, table);
+	else generateMesh(scene, scene->mRootNode, index, identity, vertices, indices, voff, ioff, bounds, bones, stream);
+	delete stream; endStage(watch, "Vertices");
 
-	writeInt(file, vcount); writeInt(file, icount); writeShort(file, nAnim);
-	file.write(reinterpret_cast<const char *>(vertices.getBytes()), vertices.getSize());
-	file.write(reinterpret_cast<const char *>(indices.getBytes()), indices.getSize());
-	writeFloat(file, bounds.botLeft.x); writeFloat(file, bounds.botLeft.y); writeFloat(file, bounds.botLeft.z);
-	writeFloat(file, bounds.topRight.x); writeFloat(file, bounds.topRight.y); writeFloat(file, bounds.topRight.z);
+	std::ostringstream box(std::ios::out | std::ios::binary); writeBounds(box, bounds);
+	memcpy(bufferOffset(output.getBytes(), hsize+vsize+isize), box.str().data(), 24);
+	std::ostringstream file(std::ios::out | std::ios::binary);
 
 	std::cout << "Bounds: [" << bounds.botLeft.x << "," << bounds.botLeft.y << "," << bounds.botLeft.z  << "] - [" << bounds.topRight.x << "," << bounds.topRight.y << "," << bounds.topRight.z << "]" << std::endl;
 
-	if(nAnim > 0){
-		std::vector<std::pair<const aiNode*, int> > nodes; std::unordered_map<std::string, int> node_map;
+	std::ostringstream palettes(std::ios::out | std::ios::binary); if(nAnim > 0){
+		NodeList nodes(&arena); NodeMap node_map(16, ArenaStringHash(), std::equal_to<ArenaString>(), NodeMap::allocator_type(&arena));
 		int index = 1; const aiNode* n = loadTree(nodes, scene->mRootNode, 0, index, node_map, bones);
-		for(int i=0; i<nAnim; i++) loadAnimation(file, scene, scene->mAnimations[i], node_map);
+		ChannelEncoder encoder(scene, node_map, baseAnim); parallelFor(encoder.channels.size(), encoder);
+		for(int i=0; i<nAnim; i++) loadAnimation(file, scene->mAnimations[i], encoder.channels.data()+encoder.first[i]);
 		int len = nodes.size(); writeShort(file, len); for(int j=0; j<len; j++){
 			std::pair<const aiNode*, int>& p = nodes[j]; const aiNode* node = p.first; writeByte(file, node->mNumChildren);
 			if(node->mNumChildren > 0) writeShort(file, p.second);
 			if(j == 0) writeMat4(file, identity*node->mTransformation); else writeMat4(file, node->mTransformation);
-			std::unordered_map<std::string,Bone>::const_iterator i = bones.bones.find(node->mNumMeshes == 0?node->mName.C_Str():(std::string(node->mName.C_Str())+"_auto"));
+			BoneData::BoneMap::const_iterator i = bones.bones.find(node->mNumMeshes == 0?bones.key(node->mName.C_Str()):bones.autoKey(node->mName));
 			if(i != bones.bones.end()){
 				writeShort(file, i->second.id); writeMat4(file, i->second.transform);
 			} else writeShort(file, -1);
-		}
+		} endStage(watch, "Animations");
+		if(BAKE_RATE > 0 && !writePalettes(palettes, scene, nAnim, file.str(), baseAnim)) return false;
 	} if(WRITE_MESHES){
-		int nMesh = meshes.size(); writeShort(file, nMesh); for(int i=0; i<nMesh; i++){
-			const MeshSubset& m = meshes[i]; writeUTF(file, m.name); writeInt(file, m.start); writeInt(file, m.end);
+		int nMesh = meshes.size(); if(nMesh > WOBJ_MAX_SUBSETS){std::cout << "Error: -writemeshes supports at most " << WOBJ_MAX_SUBSETS << " meshes, the scene has " << nMesh << std::endl; return false;}
+		writeShort(file, nMesh); for(int i=0; i<nMesh; i++){
+			const MeshSubset& m = meshes[i]; writeUTF(file, m.name);
+			if(LARGE_OUTPUT){writeLong(file, m.start); writeLong(file, m.end);} else {writeInt(file, (int)m.start); writeInt(file, (int)m.end);}
 		}
+	} std::ostringstream sections(std::ios::out | std::ios::binary);
+	if(nAnim > 0 && ROOT_MOTION_NODE != NULL){
+		std::ostringstream motion(std::ios::out | std::ios::binary); writeInt(motion, nAnim); const aiNode* node = findNode(scene->mRootNode, aiString(std::string(ROOT_MOTION_NODE)));
+		for(int i=0; i<nAnim; i++){
+			const aiAnimation* anim = scene->mAnimations[i]; const aiNodeAnim* ch = NULL;
+			for(uint c=0; c<anim->mNumChannels; c++) if(strcmp(anim->mChannels[c]->mNodeName.C_Str(), ROOT_MOTION_NODE) == 0) ch = anim->mChannels[c];
+			if(ch == NULL){writeInt(motion, 0); continue;}
+			ArenaVector<aiVectorKey>::type keys(max(ch->mNumPositionKeys, 1u), &arena); getRootMotion(node, ch, &keys[0]);
+			writeVectorArray(motion, &keys[0], ch->mNumPositionKeys, arena);
+		} writeSection(sections, FOURCC('R','M','O','T'), motion.str());
+	} if(nAnim > 0 && ADDITIVE_REFERENCE != NULL){
+		std::ostringstream clips(std::ios::out | std::ios::binary); writeInt(clips, baseAnim >= 0?nAnim-1:nAnim);
+		for(int i=0; i<nAnim; i++) if(i != baseAnim){writeInt(clips, i); writeInt(clips, baseAnim);}
+		writeSection(sections, WOBJ_ADDITIVE_SECTION, clips.str());
+	} if(nAnim > 0 && DUAL_QUAT){
+		std::ostringstream binds(std::ios::out | std::ios::binary); writeDualQuatBinds(binds, bones, arena);
+		writeSection(sections, WOBJ_DUAL_QUAT_SECTION, binds.str());
+	} if(nAnim > 0 && VAT_RATE > 0){
+		std::ostringstream vat(std::ios::out | std::ios::binary); writeVertexAnimations(vat, scene, vcount, arena);
+		writeSection(sections, FOURCC('V','A','T','S'), vat.str());
+	} if(MORPH_TARGETS){
+		std::ostringstream morphs(std::ios::out | std::ios::binary); writeMorphTargets(morphs, scene, arena);
+		writeSection(sections, FOURCC('M','R','P','H'), morphs.str());
+	} if(nAnim > 0 && BAKE_RATE > 0) writeSection(sections, FOURCC('P','A','L','S'), palettes.str());
+	if(INSTANCE_MESHES) writeSection(sections, FOURCC('I','N','S','T'), table.str());
+	else if(GROUP_MATERIALS) writeSection(sections, FOURCC('M','A','T','S'), table.str());
+	if(sections.tellp() > 0){writeInt(file, WOBJ_SECTIONS_MAGIC); file << sections.str();}
+	endStage(watch, "Sections"); std::string tail = file.str();
+	bool ok = output.append(tail.data(), tail.size()) && output.close(); endStage(watch, "Write"); return ok;
+}
+bool VERIFY = false; float VERIFY_TOLERANCE = 0;
+/** The frame rate -verify samples animations at. */
+const float VERIFY_RATE = 30;
+/** The largest and root mean square of a set of errors. */
+struct ErrorStats {
+	double maxError, sumSquares; longlong count;
+	inline ErrorStats() : maxError(0), sumSquares(0), count(0){}
+	inline void add(double e){maxError = max(maxError, e); sumSquares += e*e; count++;}
+	inline double rms() const {return count > 0?sqrt(sumSquares/count):0;}
+};
+inline double distance(const aiVector3D& a, const float* b){
+	double x = a.x-b[0], y = a.y-b[1], z = a.z-b[2]; return sqrt(x*x+y*y+z*z);
+}
+/** Computes the global transforms of the nodes of a scene at a time of one of its animations straight from the
+ * assimp scene, independently of the WOBJ writer, as the reference -verify compares the file against. Globals
+ * include the axis swap, like the node table of a WOBJ file. */
+class SceneSampler {
+	const aiScene* scene; std::map<const aiNode*, aiMatrix4x4> globals;
+	void evaluate(const aiNode* node, const aiMatrix4x4& parent, const aiAnimation* anim, double time){
+		aiMatrix4x4 local = node->mTransformation; const aiNodeAnim* ch = NULL;
+		for(uint i=0; anim != NULL && i<anim->mNumChannels; i++) if(anim->mChannels[i]->mNodeName == node->mName) ch = anim->mChannels[i];
+		if(ch != NULL){
+			aiVector3D s, p; aiQuaternion r; node->mTransformation.Decompose(s, r, p);
+			if(ch->mNumPositionKeys > 0) p = sampleKeys(ch->mPositionKeys, ch->mNumPositionKeys, time);
+			if(ch->mNumRotationKeys > 0) r = sampleKeys(ch->mRotationKeys, ch->mNumRotationKeys, time);
+			if(ch->mNumScalingKeys > 0 && !NO_SCALE) s = sampleKeys(ch->mScalingKeys, ch->mNumScalingKeys, time);
+			if(NO_SCALE) s = aiVector3D(1, 1, 1);
+			if(ROOT_MOTION_NODE != NULL && ch->mNumPositionKeys > 0 && strcmp(node->mName.C_Str(), ROOT_MOTION_NODE) == 0){
+				aiMatrix3x3 toWOBJ = getParentToWOBJ(node), toParent = toWOBJ; toParent.Inverse();
+				aiVector3D d = toWOBJ*(p-ch->mPositionKeys[0].mValue); d.z = 0; p = p-toParent*d;
+			} local = aiMatrix4x4(s, r, p);
+		} aiMatrix4x4 global = parent*local; globals[node] = global;
+		for(uint i=0; i<node->mNumChildren; i++) evaluate(node->mChildren[i], global, anim, time);
 	}
+public:
+	inline SceneSampler(const aiScene* s) : scene(s){}
+	/** Evaluates every node at a time in ticks of an animation, or in the bind pose if anim is NULL. */
+	void sample(const aiAnimation* anim, double time){evaluate(scene->mRootNode, aiMatrix4x4(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1), anim, time);}
+	inline const aiMatrix4x4& getGlobal(const aiNode* node){return globals[node];}
+};
+/** Reads back a WOBJ file written from a scene and compares it to the scene: the position and normal of every
+ * vertex, and for every animation the skinned position of every vertex at VERIFY_RATE frames per second, with the
+ * file evaluated by AnimSampler and the scene evaluated with every bone weight it has. Prints the largest and RMS
+ * errors, and returns false if the file could not be read or (with a tolerance) a position error exceeds it. */
+bool verifyScene(const char* out, const aiScene* scene, Arena& arena){
+	MappedFile f; WOBJFile wobj; if(!f.open(out) || !wobj.read(f.getBytes(), f.getSize())){std::cout << "Error: Could not read back " << out << std::endl; return false;}
+	VertexRangeList ranges(&arena); longlong vcount = 0; aiMatrix4x4 identity(1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1);
+	getVertexRanges(scene, scene->mRootNode, identity, vcount, ranges);
+	if(vcount != wobj.vertexCount){std::cout << "Error: " << out << " has " << wobj.vertexCount << " vertices, the scene has " << vcount << std::endl; return false;}
+	ErrorStats positions, normals; double worst = 0;
+	for(size_t i=0; i<ranges.size(); i++){
+		const VertexRange& r = ranges[i]; const aiMesh* mesh = scene->mMeshes[r.mesh_id];
+		aiMatrix3x3 normalMat = aiMatrix3x3(r.transform); normalMat.Inverse(); normalMat.Transpose();
+		for(uint v=0; v<mesh->mNumVertices; v++){
+			float vert[8]; memcpy(vert, wobj.getVertex(r.start+v), 32); positions.add(distance(r.transform*mesh->mVertices[v], vert));
+			if(mesh->HasNormals()){aiVector3D n = normalMat*mesh->mNormals[v]; n.Normalize(); normals.add(distance(n, vert+3));}
+		}
+	} std::cout << "Verify: Vertices: " << vcount << ", Position error: " << positions.maxError << " max, " << positions.rms() << " rms, Normal error: "
+		<< normals.maxError << " max, " << normals.rms() << " rms" << std::endl;
+	worst = positions.maxError; int baseAnim = -1; for(uint a=0; ADDITIVE_REFERENCE != NULL && a<scene->mNumAnimations; a++) if(strcmp(scene->mAnimations[a]->mName.C_Str(), ADDITIVE_REFERENCE) == 0) baseAnim = a;
+	AnimSampler sampler(wobj); SceneSampler reference(scene); std::vector<Mat4> palette(max(sampler.getBoneCount(), 1));
+	ArenaVector<float>::type skinned(vcount*6, 0, &arena); uint maxVerts = 0; for(uint m=0; m<scene->mNumMeshes; m++) maxVerts = max(maxVerts, scene->mMeshes[m]->mNumVertices);
+	ArenaVector<aiVector3D>::type sum(maxVerts, aiVector3D(), &arena); ArenaVector<float>::type weight(maxVerts, 0, &arena);
+	for(uint a=0; vcount > 0 && a<scene->mNumAnimations && a<wobj.animations.size(); a++){
+		const aiAnimation* anim = scene->mAnimations[a]; double step = (anim->mTicksPerSecond > 0?anim->mTicksPerSecond:25)/VERIFY_RATE;
+		float duration = wobj.animations[a].duration; int frames = (int)ceil(max(duration, 0.0f)/step)+1; ErrorStats skin;
+		for(int fr=0; fr<frames; fr++){
+			float t = (float)min(fr*step, (double)duration); sampler.reset();
+			if(ADDITIVE_REFERENCE == NULL || (int)a == baseAnim) sampler.sample(a, t);
+			else {if(baseAnim >= 0) sampler.sample(baseAnim, 0); sampler.sampleAdditive(a, t);}
+			sampler.evaluate(); sampler.getPalette(&palette[0]); skinVertices(wobj, &palette[0], sampler.getBoneCount(), 0, vcount, &skinned[0]);
+			reference.sample(anim, t);
+			for(size_t i=0; i<ranges.size(); i++){
+				const VertexRange& r = ranges[i]; const aiMesh* mesh = scene->mMeshes[r.mesh_id];
+				for(uint v=0; v<mesh->mNumVertices; v++){sum[v] = aiVector3D(); weight[v] = 0;}
+				for(uint b=0; b<mesh->mNumBones; b++){
+					const aiBone* bone = mesh->mBones[b]; const aiNode* node = findNode(scene->mRootNode, bone->mName); if(node == NULL) continue;
+					aiMatrix4x4 m = reference.getGlobal(node)*bone->mOffsetMatrix;
+					for(uint w=0; w<bone->mNumWeights; w++){
+						const aiVertexWeight& vw = bone->mWeights[w]; if(vw.mVertexId >= mesh->mNumVertices) continue;
+						sum[vw.mVertexId] += (m*mesh->mVertices[vw.mVertexId])*vw.mWeight; weight[vw.mVertexId] += vw.mWeight;
+					}
+				} const aiMatrix4x4& rigid = reference.getGlobal(r.node);
+				for(uint v=0; v<mesh->mNumVertices; v++)
+					skin.add(distance(weight[v] > 0?sum[v]*(1/weight[v]):rigid*mesh->mVertices[v], &skinned[(r.start+v)*6]));
+			}
+		} std::cout << "Verify: " << anim->mName.C_Str() << ", Frames: " << frames << ", Skinned position error: " << skin.maxError << " max, " << skin.rms() << " rms" << std::endl;
+		worst = max(worst, skin.maxError);
+	} if(VERIFY_TOLERANCE > 0 && worst > VERIFY_TOLERANCE){
+		std::cout << "Error: Verification failed, position error " << worst << " is over " << VERIFY_TOLERANCE << std::endl; return false;
+	} return true;
+}
+
+bool CHECKSUM = false;
+/** Prints the size and 64-bit FNV-1a hash of a written file. Output only depends on the input and the options (not
+ * on the thread count or hash map order), so the hash can be compared against the hash of a known good output to
+ * catch changes without keeping the files. Returns false if the file could not be read. */
+bool printChecksum(const char* path){
+	MappedFile f; if(!f.open(path)){std::cout << "Error: Could not read back " << path << std::endl; return false;}
+	ulonglong h = 14695981039346656037ull; const uchar* p = (const uchar*)f.getBytes();
+	for(ulonglong i=0; i<f.getSize(); i++){h ^= p[i]; h *= 1099511628211ull;}
+	std::cout << "Checksum: " << std::hex << std::setfill('0') << std::setw(16) << h << std::dec << std::setfill(' ') << ", Size: " << f.getSize() << std::endl;
+	return true;
+}
+/** Converts a scene and writes it to a new WOBJ file at the passed path. The vertices and indices are generated
+ * directly into the mapped output file, and everything after them is appended once they are done. Temporaries
+ * are allocated from the passed arena, which is reset before returning so the next conversion can reuse it.
+ * Returns false if the output file could not be written. */
+bool loadScene(const char* out, aiScene* scene, Arena& arena){
+	bool ok = convertScene(out, scene, arena); Stopwatch watch;
+	if(ok && VERIFY){ok = verifyScene(out, scene, arena); endStage(watch, "Verify");}
+	if(ok && CHECKSUM) ok = printChecksum(out);
+	arena.reset(); return ok;
 }
 
+/** Finishes an import started with no post-processing flags, timing the read and then each post-processing step. */
+const aiScene* postProcessTimed(Assimp::Importer& importer, const aiScene* scene, StepTimer* timer, int flags){
+	std::cout << "Read: " << timer->getMilliseconds() << " ms" << std::endl; return applyStepsTimed(importer, scene, flags);
+}
+/** Imports a model file, reading it (and any files it references) through memory mappings. The scene is taken
+ * over from the importer, since clips and -stream replace and free parts of it, and must be deleted when done. */
+aiScene* importScene(Assimp::Importer& importer, const char* in, int flags){
+	importer.SetIOHandler(new MappedIOSystem()); const aiScene* scene;
+	if(!TIME_STEPS) scene = importer.ReadFile(in, flags);
+	else {StepTimer* timer = new StepTimer(); importer.SetProgressHandler(timer); scene = postProcessTimed(importer, importer.ReadFile(in, 0), timer, flags);}
+	return scene != NULL?importer.GetOrphanedScene():NULL;
+}
+
+/** Parses the optional value of an option. Returns true, setting value, only if the whole argument is a positive
+ * finite number, so a following file name such as 3d_model.fbx is not taken as the value. */
+bool parseOptionalValue(const char* arg, float& value){
+	char* end; double d = strtod(arg, &end); if(end == arg || *end != 0 || !(d > 0) || !std::isfinite(d)) return false;
+	value = (float)d; return true;
+}
+/** Parses the value of an option that requires one, passed as NULL if the arguments ended before it. Returns true,
+ * setting value, only if all of it is a number from min to max, so a malformed, out of range or missing value is an
+ * error instead of silently becoming 0 or taking the next argument. */
+bool parseValue(const char* arg, double min, double max, double& value){
+	if(arg == NULL) return false; char* end; double d = strtod(arg, &end);
+	if(end == arg || *end != 0 || !(d >= min && d <= max)) return false;
+	value = d; return true;
+}
+inline const char* nextArg(int argc, char* argv[], int& i){return i+1 < argc?argv[++i]:NULL;}
+const char* USAGE = "Usage: CreateWOBJ in.fbx out.wobj [-writemeshes] [-noscale] [-droprest] [-profile minimal|fast|quality] [-enable step] [-disable step] [-timesteps] [-stream] [-large] [-tiles size] [-instance] [-materials] [-dualquat] [-bakepalettes fps] [-vat fps] [-morphs [epsilon]] [-additive bind|base] [-clips file] [-rootmotion node] [-threads n] [-quaterror degrees] [-verify [tolerance]] [-checksum]";
 int main(int argc, char *argv[]){
-	if(argc > 3 && strcmp(argv[argc-1], "-noscale") == 0){argc--; NO_SCALE = true;}
-	if(argc > 3 && strcmp(argv[argc-1], "-writemeshes") == 0){argc--; WRITE_MESHES = true;}
-	if(argc != 3){
-		std::cout << "Usage: CreateWOBJ in.fbx out.wobj [-writemeshes]" << std::endl; return -1;
+	std::vector<char*> files; ImportProfile profile = PROFILE_QUALITY; uint enabled = 0, disabled = 0;
+	for(int i=1; i<argc; i++){
+		if(strcmp(argv[i], "-noscale") == 0) NO_SCALE = true;
+		else if(strcmp(argv[i], "-writemeshes") == 0) WRITE_MESHES = true;
+		else if(strcmp(argv[i], "-droprest") == 0) DROP_REST = true;
+		else if(strcmp(argv[i], "-timesteps") == 0) TIME_STEPS = true;
+		else if(strcmp(argv[i], "-checksum") == 0) CHECKSUM = true;
+		else if(strcmp(argv[i], "-stream") == 0) STREAM_MESHES = true;
+		else if(strcmp(argv[i], "-large") == 0) LARGE_OUTPUT = true;
+		else if(strcmp(argv[i], "-instance") == 0) INSTANCE_MESHES = true;
+		else if(strcmp(argv[i], "-materials") == 0) GROUP_MATERIALS = true;
+		else if(strcmp(argv[i], "-dualquat") == 0) DUAL_QUAT = true;
+		else if(strcmp(argv[i], "-tiles") == 0){
+			double size; if(!parseValue(nextArg(argc, argv, i), 0, std::numeric_limits<float>::max(), size) || size == 0){
+				std::cout << "Error: -tiles needs a tile size above 0" << std::endl; return -1;
+			} TILE_SIZE = (float)size;
+		} else if(strcmp(argv[i], "-bakepalettes") == 0){
+			double fps; if(!parseValue(nextArg(argc, argv, i), 0, MAX_BAKE_RATE, fps) || fps == 0){
+				std::cout << "Error: -bakepalettes needs a frame rate above 0 and up to " << MAX_BAKE_RATE << std::endl; return -1;
+			} BAKE_RATE = (float)fps;
+		} else if(strcmp(argv[i], "-vat") == 0){
+			double fps; if(!parseValue(nextArg(argc, argv, i), 0, MAX_BAKE_RATE, fps) || fps == 0){
+				std::cout << "Error: -vat needs a frame rate above 0 and up to " << MAX_BAKE_RATE << std::endl; return -1;
+			} VAT_RATE = (float)fps;
+		} else if(strcmp(argv[i], "-morphs") == 0){
+			MORPH_TARGETS = true; if(i+1 < argc && parseOptionalValue(argv[i+1], MORPH_EPSILON)) i++;
+		} else if(strcmp(argv[i], "-additive") == 0 && i+1 < argc) ADDITIVE_REFERENCE = argv[++i];
+		else if(strcmp(argv[i], "-clips") == 0 && i+1 < argc) CLIPS_FILE = argv[++i];
+		else if(strcmp(argv[i], "-rootmotion") == 0 && i+1 < argc) ROOT_MOTION_NODE = argv[++i];
+		else if(strcmp(argv[i], "-threads") == 0){
+			double n; if(!parseValue(nextArg(argc, argv, i), 1, MAX_THREADS, n) || n != floor(n)){
+				std::cout << "Error: -threads needs a whole number from 1 to " << MAX_THREADS << std::endl; return -1;
+			} THREADS = (int)n;
+		} else if(strcmp(argv[i], "-verify") == 0){
+			VERIFY = true; if(i+1 < argc && parseOptionalValue(argv[i+1], VERIFY_TOLERANCE)) i++;
+		} else if(strcmp(argv[i], "-quaterror") == 0){
+			double degrees; if(!parseValue(nextArg(argc, argv, i), 0, 180, degrees)){
+				std::cout << "Error: -quaterror needs an angle from 0 to 180 degrees" << std::endl; return -1;
+			} QUAT_TOLERANCE = (float)(degrees*AI_MATH_PI/180);
+		} else if(strcmp(argv[i], "-profile") == 0 && i+1 < argc){
+			if(!parseProfile(argv[++i], profile)){std::cout << "Error: Unknown profile " << argv[i] << std::endl; return -1;}
+		} else if((strcmp(argv[i], "-enable") == 0 || strcmp(argv[i], "-disable") == 0) && i+1 < argc){
+			uint step = getStepFlag(argv[i+1]);
+			if(step == 0){std::cout << "Error: Unknown post-processing step " << argv[i+1] << std::endl; return -1;}
+			if(argv[i][1] == 'e'){enabled |= step; disabled &= ~step;} else {disabled |= step; enabled &= ~step;} i++;
+		} else files.push_back(argv[i]);
+	} if(files.size() != 2){
+		std::cout << USAGE << std::endl; return -1;
+	} if((INSTANCE_MESHES?1:0)+(GROUP_MATERIALS?1:0)+(TILE_SIZE > 0?1:0) > 1){
+		std::cout << "Error: Only one of -instance, -materials and -tiles can be used" << std::endl; return -1;
+	} if(TILE_SIZE > 0 && (STREAM_MESHES || WRITE_MESHES || DUAL_QUAT)){
+		std::cout << "Error: -tiles cannot be combined with -stream, -writemeshes or -dualquat" << std::endl; return -1;
+	} if((VAT_RATE > 0 || MORPH_TARGETS || VERIFY) && (STREAM_MESHES || INSTANCE_MESHES || GROUP_MATERIALS || TILE_SIZE > 0)){
+		std::cout << "Error: -vat, -morphs and -verify cannot be combined with -stream, -instance, -materials or -tiles" << std::endl; return -1;
 	} aiLogStream stream = aiGetPredefinedLogStream(aiDefaultLogStream_STDOUT,NULL);
-    aiAttachLogStream(&stream); char* in = argv[1]; char* out = argv[2];
-	int flags = aiProcessPreset_TargetRealtime_Quality|aiProcess_OptimizeGraph|aiProcess_MakeLeftHanded|aiProcess_FlipUVs;
-	flags &= ~aiProcess_SplitLargeMeshes;
-	if(!WRITE_MESHES) flags |= aiProcess_OptimizeMeshes;
-	const aiScene* scene = aiImportFile(in,flags);
-	if(scene){
-		std::ofstream file(out, std::ios::out | std::ios::binary | std::ios::trunc);
-		if(!file.is_open()){
-			std::cout << "Error: Could not write " << out << std::endl; return -1;
-		} loadScene(file, scene); file.close();
-		aiReleaseImport(scene);
+    aiAttachLogStream(&stream); char* in = files[0]; char* out = files[1];
+	if(INSTANCE_MESHES) enabled |= aiProcess_FindInstances&~disabled;
+	int flags = (getProfileFlags(profile, !WRITE_MESHES && !INSTANCE_MESHES)|enabled)&~disabled;
+	// both steps bake node transforms into copies of the meshes, which would leave nothing to instance
+	if(INSTANCE_MESHES) flags &= ~(aiProcess_OptimizeGraph|aiProcess_PreTransformVertices);
+	Assimp::Importer importer; aiScene* scene = importScene(importer, in, flags);
+	if(scene && !sanitizeScene(scene)){delete scene; return -1;}
+	std::vector<ClipRange> clips; if(scene && CLIPS_FILE != NULL){
+		if(!readClips(CLIPS_FILE, scene, clips)){delete scene; return -1;}
+		splitClips(scene, clips);
+	} Arena arena; bool ok = scene == NULL || loadScene(out, scene, arena); delete scene;
+	if(!ok){
+		std::cout << "Error: Could not write " << out << std::endl; return -1;
 	} return 0;
 }
\ No newline at end of file
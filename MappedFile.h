@@ -0,0 +1,238 @@
+/** @file MappedFile.h
+ * Memory mapped input and output files, and an assimp IOSystem that serves imports directly from mapped files.
+ */
+
+#ifndef CORE_MAPPEDFILE_H_INCLUDED
+#define CORE_MAPPEDFILE_H_INCLUDED
+
+#include "common.h"
+
+#include <assimp/IOSystem.hpp>
+#include <assimp/IOStream.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** A file mapped read-only into memory. The whole file is mapped at once and hinted for sequential access,
+ * so the kernel reads ahead aggressively and no intermediate stdio buffers or copies are needed.
+ * An empty file opens successfully with a NULL data pointer and a length of 0.
+ */
+class MappedFile {
+	const void* data; ulonglong length;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int fd;
+#endif
+	MappedFile(const MappedFile&); MappedFile& operator=(const MappedFile&);
+public:
+#ifdef _WIN32
+	inline MappedFile() : data(NULL), length(0), file(INVALID_HANDLE_VALUE), mapping(NULL){}
+#else
+	inline MappedFile() : data(NULL), length(0), fd(-1){}
+#endif
+	inline ~MappedFile(){close();}
+	/** Maps the file at the passed path. Returns false if the file could not be opened or mapped. */
+	bool open(const char* path){
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size; if(!GetFileSizeEx(file, &size)){close(); return false;}
+		length = size.QuadPart; if(length == 0) return true;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(mapping == NULL){close(); return false;}
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if(data == NULL){close(); return false;}
+#else
+		fd = ::open(path, O_RDONLY); if(fd < 0) return false;
+		struct stat st; if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){close(); return false;}
+		length = st.st_size; if(length == 0) return true;
+		void* ptr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED){close(); return false;}
+		data = ptr; madvise(ptr, length, MADV_SEQUENTIAL);
+#endif
+		return true;
+	}
+	/** Unmaps the file. Any pointers previously returned by getBytes() become invalid. */
+	void close(){
+#ifdef _WIN32
+		if(data != NULL) UnmapViewOfFile(data);
+		if(mapping != NULL) CloseHandle(mapping);
+		if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL; file = INVALID_HANDLE_VALUE;
+#else
+		if(data != NULL) munmap(const_cast<void*>(data), length);
+		if(fd >= 0) ::close(fd);
+		fd = -1;
+#endif
+		data = NULL; length = 0;
+	}
+	inline const void* getBytes() const {return data;}
+	inline ulonglong getSize() const {return length;}
+};
+
+/** An assimp IOStream that reads from a MappedFile. Reads are plain copies out of the mapping, and seeking is free. */
+class MappedIOStream : public Assimp::IOStream {
+	MappedFile* file; ulonglong pos;
+public:
+	/** Creates a stream over the passed file, taking ownership of it. */
+	inline MappedIOStream(MappedFile* f) : file(f), pos(0){}
+	~MappedIOStream(){delete file;}
+	size_t Read(void* buffer, size_t size, size_t count){
+		if(size == 0) return 0;
+		ulonglong avail = (file->getSize()-pos)/size; if(count > avail) count = (size_t)avail;
+		memcpy(buffer, bufferOffset(file->getBytes(), (ptr_diff_t)pos), size*count); pos += size*count; return count;
+	}
+	size_t Write(const void*, size_t, size_t){return 0;}
+	aiReturn Seek(size_t offset, aiOrigin origin){
+		ulonglong base = (origin == aiOrigin_SET)?0:((origin == aiOrigin_CUR)?pos:file->getSize());
+		if(base+offset > file->getSize()) return aiReturn_FAILURE;
+		pos = base+offset; return aiReturn_SUCCESS;
+	}
+	size_t Tell() const {return (size_t)pos;}
+	size_t FileSize() const {return (size_t)file->getSize();}
+	void Flush(){}
+};
+
+/** An assimp IOSystem that opens every file read by an importer as a MappedFile, so large model files are
+ * read through the page cache instead of many small stdio reads.
+ */
+class MappedIOSystem : public Assimp::IOSystem {
+public:
+	bool Exists(const char* path) const {
+#ifdef _WIN32
+		DWORD attrib = GetFileAttributesA(path); return attrib != INVALID_FILE_ATTRIBUTES && !(attrib & FILE_ATTRIBUTE_DIRECTORY);
+#else
+		struct stat st; return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+#endif
+	}
+#ifdef _WIN32
+	char getOsSeparator() const {return '\\';}
+#else
+	char getOsSeparator() const {return '/';}
+#endif
+	Assimp::IOStream* Open(const char* path, const char* mode = "rb"){
+		if(strchr(mode, 'w') != NULL || strchr(mode, 'a') != NULL || strchr(mode, '+') != NULL) return NULL;
+		MappedFile* f = new MappedFile(); if(!f->open(path)){delete f; return NULL;}
+		return new MappedIOStream(f);
+	}
+	void Close(Assimp::IOStream* stream){delete stream;}
+};
+
+/** An output file of a known size mapped read-write into memory, so data can be generated directly in its final
+ * location in the file instead of being staged in memory and copied. The file is created (or truncated) and
+ * extended to its size when opened, so the mapped bytes start out as zero. The space is allocated on disk up front,
+ * so a full disk makes open() fail instead of faulting when the mapped bytes are written. Data whose size is only known after
+ * the mapped part has been generated can be appended after it.
+ */
+class MappedOutputFile {
+	void* data; ulonglong length, end;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int fd;
+#endif
+	MappedOutputFile(const MappedOutputFile&); MappedOutputFile& operator=(const MappedOutputFile&);
+	void unmap(){
+#ifdef _WIN32
+		if(data != NULL) UnmapViewOfFile(data);
+		if(mapping != NULL) CloseHandle(mapping);
+		mapping = NULL;
+#else
+		if(data != NULL) munmap(data, length);
+#endif
+		data = NULL;
+	}
+public:
+#ifdef _WIN32
+	inline MappedOutputFile() : data(NULL), length(0), end(0), file(INVALID_HANDLE_VALUE), mapping(NULL){}
+#else
+	inline MappedOutputFile() : data(NULL), length(0), end(0), fd(-1){}
+#endif
+	inline ~MappedOutputFile(){close();}
+	/** Creates the file at the passed path with the passed size, and maps all of it. Returns false on failure. */
+	bool open(const char* path, ulonglong size){
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ|GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(file == INVALID_HANDLE_VALUE) return false;
+		length = end = size; if(size == 0) return true;
+		LARGE_INTEGER pos; pos.QuadPart = (LONGLONG)size;
+		if(!SetFilePointerEx(file, pos, NULL, FILE_BEGIN) || !SetEndOfFile(file)){close(); return false;}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(size>>32), (DWORD)size, NULL);
+		if(mapping == NULL){close(); return false;}
+		data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+		if(data == NULL){close(); return false;}
+#else
+		fd = ::open(path, O_RDWR|O_CREAT|O_TRUNC, 0644); if(fd < 0) return false;
+		length = end = size; if(size == 0) return true;
+		if(posix_fallocate(fd, 0, size) != 0){close(); return false;}
+		void* ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+		if(ptr == MAP_FAILED){close(); return false;}
+		data = ptr;
+#endif
+		return true;
+	}
+	/** Writes bytes to the end of the file, after the mapped region and anything appended before. */
+	bool append(const void* bytes, ulonglong len){
+		if(len == 0) return true;
+#ifdef _WIN32
+		ulonglong off = 0; while(off < len){
+			ulonglong at = end+off; DWORD chunk = (DWORD)std::min<ulonglong>(len-off, 0x40000000), written;
+			OVERLAPPED o; memset(&o, 0, sizeof(o)); o.Offset = (DWORD)at; o.OffsetHigh = (DWORD)(at>>32);
+			if(!WriteFile(file, bufferOffset(bytes, (ptr_diff_t)off), chunk, &written, &o) || written == 0) return false;
+			off += written;
+		}
+#else
+		ulonglong off = 0; while(off < len){
+			ssize_t written = pwrite(fd, bufferOffset(bytes, (ptr_diff_t)off), len-off, end+off);
+			if(written <= 0) return false; off += written;
+		}
+#endif
+		end += len; return true;
+	}
+	/** Starts writing a finished range of the mapped region back to the file, and drops it from this process's
+	 * working set so generating a file larger than memory only keeps the range being generated resident.
+	 * The range stays mapped, and is read back from the file if it is accessed again. */
+	void release(ulonglong offset, ulonglong len){
+		if(data == NULL || len == 0) return;
+#ifdef _WIN32
+		FlushViewOfFile(bufferOffset(data, (ptr_diff_t)offset), (SIZE_T)len);
+		VirtualUnlock(bufferOffset(data, (ptr_diff_t)offset), (SIZE_T)len);
+#else
+		ulonglong page = sysconf(_SC_PAGESIZE), start = offset-offset%page;
+		len += offset-start; void* ptr = bufferOffset(data, (ptr_diff_t)start);
+		msync(ptr, len, MS_ASYNC); madvise(ptr, len, MADV_DONTNEED);
+#endif
+	}
+	/** Unmaps and closes the file. Returns false if the mapped data could not be written back. */
+	bool close(){
+		bool ok = true;
+#ifdef _WIN32
+		if(data != NULL) ok = FlushViewOfFile(data, 0) != 0;
+		unmap(); if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+#else
+		unmap(); if(fd >= 0) ok = ::close(fd) == 0;
+		fd = -1;
+#endif
+		length = end = 0; return ok;
+	}
+	inline void* getBytes() const {return data;}
+	inline ulonglong getSize() const {return length;}
+};
+
+#endif // CORE_MAPPEDFILE_H_INCLUDED
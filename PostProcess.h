@@ -0,0 +1,120 @@
+/** @file PostProcess.h
+ * Named assimp post-processing steps, import profiles, and per-step timing of the post-processing pipeline.
+ */
+
+#ifndef CORE_POSTPROCESS_H_INCLUDED
+#define CORE_POSTPROCESS_H_INCLUDED
+
+#include "common.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+/** An assimp post-processing step flag, and the name it is enabled or disabled by on the command line. */
+struct PostProcessStep {const char* name; uint flag;};
+
+/** Every assimp post-processing step, in the order assimp executes them. */
+const PostProcessStep POST_PROCESS_STEPS[] = {
+	{"ValidateDataStructure", aiProcess_ValidateDataStructure}, {"MakeLeftHanded", aiProcess_MakeLeftHanded},
+	{"FlipUVs", aiProcess_FlipUVs}, {"FlipWindingOrder", aiProcess_FlipWindingOrder},
+	{"RemoveComponent", aiProcess_RemoveComponent}, {"RemoveRedundantMaterials", aiProcess_RemoveRedundantMaterials},
+	{"EmbedTextures", aiProcess_EmbedTextures}, {"FindInstances", aiProcess_FindInstances},
+	{"OptimizeGraph", aiProcess_OptimizeGraph}, {"FindDegenerates", aiProcess_FindDegenerates},
+	{"GenUVCoords", aiProcess_GenUVCoords}, {"TransformUVCoords", aiProcess_TransformUVCoords},
+	{"GlobalScale", aiProcess_GlobalScale}, {"PreTransformVertices", aiProcess_PreTransformVertices},
+	{"Triangulate", aiProcess_Triangulate}, {"SortByPType", aiProcess_SortByPType},
+	{"FindInvalidData", aiProcess_FindInvalidData}, {"OptimizeMeshes", aiProcess_OptimizeMeshes},
+	{"FixInfacingNormals", aiProcess_FixInfacingNormals}, {"SplitByBoneCount", aiProcess_SplitByBoneCount},
+	{"SplitLargeMeshes", aiProcess_SplitLargeMeshes}, {"GenNormals", aiProcess_GenNormals},
+	{"GenSmoothNormals", aiProcess_GenSmoothNormals}, {"CalcTangentSpace", aiProcess_CalcTangentSpace},
+	{"JoinIdenticalVertices", aiProcess_JoinIdenticalVertices}, {"Debone", aiProcess_Debone},
+	{"LimitBoneWeights", aiProcess_LimitBoneWeights}, {"ImproveCacheLocality", aiProcess_ImproveCacheLocality},
+	{"GenBoundingBoxes", aiProcess_GenBoundingBoxes}
+};
+const int NUM_POST_PROCESS_STEPS = sizeof(POST_PROCESS_STEPS)/sizeof(PostProcessStep);
+
+/** Returns the flag of the post-processing step with the passed name (with or without the aiProcess_ prefix),
+ * or 0 if there is no such step. */
+inline uint getStepFlag(const char* name){
+	if(strncmp(name, "aiProcess_", 10) == 0) name += 10;
+	for(int i=0; i<NUM_POST_PROCESS_STEPS; i++) if(strcmp(POST_PROCESS_STEPS[i].name, name) == 0) return POST_PROCESS_STEPS[i].flag;
+	return 0;
+}
+
+/** A preset of post-processing steps to import with. */
+enum ImportProfile {
+	/** Only the steps the WOBJ format needs: triangles, left handed coordinates and flipped UVs. */ PROFILE_MINIMAL = 0,
+	/** Cheap normal generation and vertex joining, skipping the expensive cleanup and cache optimization steps. */ PROFILE_FAST = 1,
+	/** The full realtime quality preset. */ PROFILE_QUALITY = 2
+};
+
+/** Parses a profile name (minimal, fast or quality). Returns false if the name is not a profile. */
+inline bool parseProfile(const char* name, ImportProfile& profile){
+	if(strcmp(name, "minimal") == 0) profile = PROFILE_MINIMAL;
+	else if(strcmp(name, "fast") == 0) profile = PROFILE_FAST;
+	else if(strcmp(name, "quality") == 0) profile = PROFILE_QUALITY;
+	else return false;
+	return true;
+}
+
+/** Returns the post-processing flags for a profile.
+ * @param mergeMeshes If true, meshes sharing a material are merged. Must be false if mesh subsets are written. */
+inline uint getProfileFlags(ImportProfile profile, bool mergeMeshes){
+	uint flags = aiProcess_Triangulate|aiProcess_SortByPType|aiProcess_MakeLeftHanded|aiProcess_FlipUVs;
+	if(profile == PROFILE_FAST) flags |= aiProcess_GenNormals|aiProcess_JoinIdenticalVertices|aiProcess_GenUVCoords|aiProcess_LimitBoneWeights|aiProcess_OptimizeGraph;
+	else if(profile == PROFILE_QUALITY) flags |= (aiProcessPreset_TargetRealtime_Quality|aiProcess_OptimizeGraph)&~aiProcess_SplitLargeMeshes;
+	if(mergeMeshes && profile != PROFILE_MINIMAL) flags |= aiProcess_OptimizeMeshes;
+	return flags;
+}
+
+/** A progress handler that records when assimp reports file reading and post-processing progress, giving the
+ * time assimp itself spent between its first and last report for the most recent read or post-processing run. */
+class StepTimer : public Assimp::ProgressHandler {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point first, last; bool started;
+	void mark(){Clock::time_point t = Clock::now(); if(!started){first = t; started = true;} last = t;}
+public:
+	inline StepTimer() : started(false){}
+	bool Update(float){return true;}
+	void UpdateFileRead(int, int){mark();}
+	void UpdatePostProcess(int, int){mark();}
+	/** Starts timing a new run. */
+	inline void reset(){started = false;}
+	/** Returns the milliseconds between the first and last progress report since reset(). */
+	inline double getMilliseconds() const {return started?std::chrono::duration<double, std::milli>(last-first).count():0;}
+};
+
+/** Measures the time between laps, for timing the stages of a conversion. */
+class Stopwatch {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start;
+public:
+	inline Stopwatch() : start(Clock::now()){}
+	/** Returns the milliseconds since the last lap (or since the stopwatch was created), and starts a new lap. */
+	inline double lap(){Clock::time_point t = Clock::now(); double ms = std::chrono::duration<double, std::milli>(t-start).count(); start = t; return ms;}
+};
+
+/** Post-processes an imported scene one step at a time in assimp's order, printing how long each step took,
+ * slowest first. The scene must have been read without any post-processing flags. Installing the step timer
+ * deletes the importer's previous progress handler. Returns the processed scene, or NULL if a step failed. */
+inline const aiScene* applyStepsTimed(Assimp::Importer& importer, const aiScene* scene, uint flags){
+	StepTimer* timer = new StepTimer(); importer.SetProgressHandler(timer);
+	std::vector<std::pair<double, const char*> > times; double total = 0;
+	for(int i=0; i<NUM_POST_PROCESS_STEPS && scene != NULL; i++){
+		if((flags & POST_PROCESS_STEPS[i].flag) == 0) continue;
+		timer->reset(); scene = importer.ApplyPostProcessing(POST_PROCESS_STEPS[i].flag);
+		times.push_back(std::make_pair(timer->getMilliseconds(), POST_PROCESS_STEPS[i].name)); total += times.back().first;
+	} std::sort(times.begin(), times.end());
+	for(int i=(int)times.size()-1; i>=0; i--) std::cout << "Step: " << times[i].second << " " << times[i].first << " ms" << std::endl;
+	std::cout << "Post-processing: " << total << " ms" << std::endl;
+	importer.SetProgressHandler(NULL); delete timer; return scene; // assimp hands custom handlers back when reset
+}
+
+#endif // CORE_POSTPROCESS_H_INCLUDED
@@ -0,0 +1,172 @@
+/** @file SanitizeScene.h
+ * Checks imported scenes for data the conversion cannot handle, repairing what can be repaired (invalid faces,
+ * bone weights and animation keys, zero-length normals and non-finite values) and rejecting the rest, so malformed input files fail
+ * with an error instead of crashing the converter or producing a broken WOBJ file.
+ */
+
+#ifndef CORE_SANITIZESCENE_H_INCLUDED
+#define CORE_SANITIZESCENE_H_INCLUDED
+
+#include "common.h"
+
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+/** The deepest node tree a scene can have, since the conversion walks node trees recursively. */
+const int MAX_NODE_DEPTH = 1000;
+/** The most nodes an animated scene can have, since animation channels store node indices as shorts. */
+const int MAX_NODES = 32767;
+/** The most children a node of an animated scene can have, since the node table stores child counts as bytes. */
+const int MAX_CHILDREN = 255;
+
+/** Counts of each kind of repair made to a scene. */
+struct SanitizeStats {
+	longlong faces, values, weights, keys, transforms, normals;
+	inline SanitizeStats() : faces(0), values(0), weights(0), keys(0), transforms(0), normals(0){}
+};
+
+inline bool isFinite(const aiVector3D& v){return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);}
+inline bool isFinite(const aiMatrix4x4& m){
+	for(int i=0; i<4; i++) for(int j=0; j<4; j++) if(!std::isfinite(m[i][j])) return false;
+	return true;
+}
+/** Returns false if a key's value cannot be used. */
+inline bool sanitizeValue(aiVector3D& v){return isFinite(v);}
+/** Rotations must also have a length to normalize by, and are normalized if they are not close to unit length. */
+inline bool sanitizeValue(aiQuaternion& q){
+	float len = sqrt(q.w*q.w+q.x*q.x+q.y*q.y+q.z*q.z); if(!std::isfinite(len) || len < 1e-6f) return false;
+	if(fabs(len-1) > 0.0001f){q.w /= len; q.x /= len; q.y /= len; q.z /= len;} return true;
+}
+
+/** Replaces the non-finite vectors of an array, which may be NULL, with zero. */
+inline void sanitizeVectors(aiVector3D* v, uint count, SanitizeStats& stats){
+	if(v != NULL) for(uint i=0; i<count; i++) if(!isFinite(v[i])){v[i] = aiVector3D(); stats.values++;}
+}
+/** Removes the faces of a triangle mesh that are not triangles, reference vertices the mesh does not have, or
+ * use a vertex more than once. Removed faces are swapped to the end of the array, which still owns them. */
+inline void sanitizeFaces(aiMesh* mesh, SanitizeStats& stats){
+	if(mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || mesh->mFaces == NULL) return;
+	uint kept = 0, n = mesh->mNumVertices;
+	for(uint f=0; f<mesh->mNumFaces; f++){
+		aiFace& face = mesh->mFaces[f]; const uint* i = face.mIndices;
+		if(face.mNumIndices != 3 || i == NULL || i[0] >= n || i[1] >= n || i[2] >= n || i[0] == i[1] || i[1] == i[2] || i[0] == i[2]){stats.faces++; continue;}
+		if(kept != f){std::swap(mesh->mFaces[kept].mNumIndices, face.mNumIndices); std::swap(mesh->mFaces[kept].mIndices, face.mIndices);} kept++;
+	} mesh->mNumFaces = kept;
+}
+/** Removes bone weights that reference vertices the mesh does not have or are negative or not finite, and
+ * replaces non-finite offset matrices with the identity. */
+inline void sanitizeBones(aiMesh* mesh, SanitizeStats& stats){
+	for(uint b=0; b<mesh->mNumBones; b++){
+		aiBone* bone = mesh->mBones[b]; uint kept = 0;
+		if(!isFinite(bone->mOffsetMatrix)){bone->mOffsetMatrix = aiMatrix4x4(); stats.transforms++;}
+		for(uint w=0; w<bone->mNumWeights; w++){
+			const aiVertexWeight& vw = bone->mWeights[w];
+			if(vw.mVertexId >= mesh->mNumVertices || !(vw.mWeight >= 0) || !std::isfinite(vw.mWeight)) stats.weights++;
+			else bone->mWeights[kept++] = vw;
+		} bone->mNumWeights = kept;
+	}
+}
+/** Replaces zero-length normals, which have no direction to transform or normalize, with the normalized sum of the
+ * normals of the triangles using the vertex (weighted by their area), or with the y axis if that is zero too. Must
+ * be called once the faces and positions have been sanitized. */
+inline void sanitizeNormals(aiMesh* mesh, SanitizeStats& stats){
+	if(mesh->mNormals == NULL) return;
+	uint n = mesh->mNumVertices, v = 0; while(v < n && mesh->mNormals[v].SquareLength() > 1e-12f) v++;
+	if(v == n) return;
+	std::vector<aiVector3D> sum(n);
+	if(mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE && mesh->mFaces != NULL && mesh->mVertices != NULL) for(uint f=0; f<mesh->mNumFaces; f++){
+		const uint* i = mesh->mFaces[f].mIndices; const aiVector3D* p = mesh->mVertices;
+		aiVector3D c = (p[i[1]]-p[i[0]])^(p[i[2]]-p[i[0]]); sum[i[0]] += c; sum[i[1]] += c; sum[i[2]] += c;
+	} for(; v<n; v++) if(!(mesh->mNormals[v].SquareLength() > 1e-12f)){
+		float len = sum[v].Length(); mesh->mNormals[v] = (len > 0 && std::isfinite(len))?sum[v]*(1/len):aiVector3D(0, 1, 0); stats.normals++;
+	}
+}
+/** Sanitizes the faces, bones and vertices of a mesh. Returns false, printing an error, if it references a
+ * material the scene does not have. */
+inline bool sanitizeMesh(const aiScene* scene, aiMesh* mesh, SanitizeStats& stats){
+	if(mesh->mMaterialIndex >= scene->mNumMaterials){
+		std::cout << "Error: Mesh " << mesh->mName.C_Str() << " references material " << mesh->mMaterialIndex << ", the scene has " << scene->mNumMaterials << std::endl; return false;
+	} sanitizeFaces(mesh, stats); sanitizeBones(mesh, stats);
+	sanitizeVectors(mesh->mVertices, mesh->mNumVertices, stats); sanitizeVectors(mesh->mNormals, mesh->mNumVertices, stats);
+	sanitizeVectors(mesh->mTextureCoords[0], mesh->mNumVertices, stats); sanitizeNormals(mesh, stats);
+	for(uint t=0; t<mesh->mNumAnimMeshes; t++){
+		aiAnimMesh* am = mesh->mAnimMeshes[t];
+		sanitizeVectors(am->mVertices, am->mNumVertices, stats); sanitizeVectors(am->mNormals, am->mNumVertices, stats);
+	} return true;
+}
+
+/** Removes the keys of a track with non-finite times or unusable values, and keys that come before the key kept
+ * before them, so the track is sorted. If no key is left, the track gets a single key holding value. */
+template<class K, class V> void sanitizeTrack(K*& keys, uint& count, const V& value, SanitizeStats& stats){
+	uint kept = 0;
+	for(uint i=0; i<count; i++){
+		K k = keys[i]; if(!std::isfinite(k.mTime) || !sanitizeValue(k.mValue) || (kept > 0 && k.mTime < keys[kept-1].mTime)){stats.keys++; continue;}
+		keys[kept++] = k;
+	} if(kept == 0){if(count == 0){delete[] keys; keys = new K[1];} keys[0] = K(0, value); kept = 1;}
+	count = kept;
+}
+/** Sanitizes the tracks of an animation, and replaces non-finite or negative durations with the time of its last
+ * key and invalid tick rates with 0 (the default rate). Tracks with no usable keys hold their node's bind pose. */
+inline void sanitizeAnimation(aiScene* scene, aiAnimation* anim, SanitizeStats& stats){
+	if(!std::isfinite(anim->mTicksPerSecond) || anim->mTicksPerSecond < 0){anim->mTicksPerSecond = 0; stats.values++;}
+	double end = 0;
+	for(uint c=0; c<anim->mNumChannels; c++){
+		aiNodeAnim* ch = anim->mChannels[c]; const aiNode* node = scene->mRootNode->FindNode(ch->mNodeName.C_Str());
+		aiVector3D s(1, 1, 1), p; aiQuaternion r; if(node != NULL) node->mTransformation.Decompose(s, r, p);
+		if(!isFinite(s) || !isFinite(p) || !sanitizeValue(r)){s = aiVector3D(1, 1, 1); p = aiVector3D(); r = aiQuaternion();}
+		sanitizeTrack(ch->mPositionKeys, ch->mNumPositionKeys, p, stats); sanitizeTrack(ch->mRotationKeys, ch->mNumRotationKeys, r, stats);
+		sanitizeTrack(ch->mScalingKeys, ch->mNumScalingKeys, s, stats);
+		end = std::max(end, std::max(ch->mPositionKeys[ch->mNumPositionKeys-1].mTime, std::max(ch->mRotationKeys[ch->mNumRotationKeys-1].mTime, ch->mScalingKeys[ch->mNumScalingKeys-1].mTime)));
+	} for(uint c=0; c<anim->mNumMorphMeshChannels; c++){
+		aiMeshMorphAnim* ch = anim->mMorphMeshChannels[c];
+		for(uint k=0; k<ch->mNumKeys; k++) for(uint j=0; j<ch->mKeys[k].mNumValuesAndWeights; j++)
+			if(!std::isfinite(ch->mKeys[k].mWeights[j])){ch->mKeys[k].mWeights[j] = 0; stats.values++;}
+	} if(!std::isfinite(anim->mDuration) || anim->mDuration < 0){anim->mDuration = end; stats.values++;}
+}
+
+/** Checks that a scene's node tree is a tree no deeper than MAX_NODE_DEPTH whose mesh references are valid and,
+ * for animated scenes, that its node table fits in a WOBJ file. Non-finite transforms are replaced with the
+ * identity. The tree is walked with a stack rather than recursively, since it may be too deep to recurse into. */
+inline bool sanitizeTree(aiScene* scene, SanitizeStats& stats){
+	std::vector<std::pair<aiNode*, int> > stack(1, std::make_pair(scene->mRootNode, 1)); longlong count = 0; bool animated = scene->HasAnimations();
+	while(!stack.empty()){
+		aiNode* node = stack.back().first; int depth = stack.back().second; stack.pop_back(); count++;
+		if(depth > MAX_NODE_DEPTH){std::cout << "Error: The node tree is deeper than " << MAX_NODE_DEPTH << " nodes" << std::endl; return false;}
+		if(animated && node->mNumChildren > (uint)MAX_CHILDREN){
+			std::cout << "Error: Node " << node->mName.C_Str() << " has " << node->mNumChildren << " children, nodes of animated scenes can have at most " << MAX_CHILDREN << std::endl; return false;
+		} for(uint i=0; i<node->mNumMeshes; i++) if(node->mMeshes[i] >= scene->mNumMeshes){
+			std::cout << "Error: Node " << node->mName.C_Str() << " references mesh " << node->mMeshes[i] << ", the scene has " << scene->mNumMeshes << std::endl; return false;
+		} if(!isFinite(node->mTransformation)){node->mTransformation = aiMatrix4x4(); stats.transforms++;}
+		for(uint i=0; i<node->mNumChildren; i++){
+			aiNode* child = node->mChildren[i];
+			if(child == NULL || child->mParent != node){std::cout << "Error: The children of node " << node->mName.C_Str() << " do not form a tree" << std::endl; return false;}
+			stack.push_back(std::make_pair(child, depth+1));
+		}
+	} if(animated && count > MAX_NODES){std::cout << "Error: The scene has " << count << " nodes, animated scenes can have at most " << MAX_NODES << std::endl; return false;}
+	return true;
+}
+
+/** Checks and repairs an imported scene before it is converted, printing a warning for each kind of repair made.
+ * Returns false, printing an error, if the scene cannot be converted. */
+inline bool sanitizeScene(aiScene* scene){
+	SanitizeStats stats;
+	if(scene->mRootNode == NULL){std::cout << "Error: The scene has no root node" << std::endl; return false;}
+	for(uint i=0; i<scene->mNumMeshes; i++) if(scene->mMeshes[i] == NULL){std::cout << "Error: Mesh " << i << " of the scene is missing" << std::endl; return false;}
+	if(!sanitizeTree(scene, stats)) return false;
+	for(uint i=0; i<scene->mNumMeshes; i++) if(!sanitizeMesh(scene, scene->mMeshes[i], stats)) return false;
+	for(uint i=0; i<scene->mNumAnimations; i++) sanitizeAnimation(scene, scene->mAnimations[i], stats);
+	if(stats.faces > 0) std::cout << "Warning: Removed " << stats.faces << " faces that were not triangles, were degenerate or referenced missing vertices" << std::endl;
+	if(stats.weights > 0) std::cout << "Warning: Removed " << stats.weights << " bone weights that were negative, not finite or referenced missing vertices" << std::endl;
+	if(stats.keys > 0) std::cout << "Warning: Removed " << stats.keys << " animation keys that were out of order or had invalid values" << std::endl;
+	if(stats.normals > 0) std::cout << "Warning: Replaced " << stats.normals << " zero-length normals with the normals of their faces" << std::endl;
+	if(stats.values > 0) std::cout << "Warning: Replaced " << stats.values << " non-finite values" << std::endl;
+	if(stats.transforms > 0) std::cout << "Warning: Replaced " << stats.transforms << " non-finite transforms with the identity" << std::endl;
+	return true;
+}
+
+#endif // CORE_SANITIZESCENE_H_INCLUDED
@@ -6,6 +6,7 @@
 #include "vec.h"
 #include "half_float.h"
 
+#include <cstring>
 #include <vector>
 
 /** A function which converts a pointer to a vertex attribute in any format to a float4 value. */
@@ -24,12 +25,13 @@ template<typename TYPE> class VertexAttrib<TYPE, 1, true> {
     typedef TYPE type; enum{n_elem=1, normalized=true};
     TYPE elem[1];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(normalizeValue<TYPE,float>(a[0]),0,0,1);
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = normalizeValue<float,TYPE>(val.x);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 template<typename TYPE> class VertexAttrib<TYPE, 1, false> {
@@ -37,12 +39,13 @@ template<typename TYPE> class VertexAttrib<TYPE, 1, false> {
     typedef TYPE type; enum{n_elem=1, normalized=false};
     TYPE elem[1];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(float(a[0]),0,0,1);
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = TYPE(val.x);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 template<typename TYPE> class VertexAttrib<TYPE, 2, true> {
@@ -50,12 +53,13 @@ template<typename TYPE> class VertexAttrib<TYPE, 2, true> {
     typedef TYPE type; enum{n_elem=2, normalized=true};
     TYPE elem[2];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(normalizeValue<TYPE,float>(a[0]),normalizeValue<TYPE,float>(a[1]),0,1);
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = normalizeValue<float,TYPE>(val.x); a[1] = normalizeValue<float,TYPE>(val.y);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 template<typename TYPE> class VertexAttrib<TYPE, 2, false> {
@@ -63,12 +67,13 @@ template<typename TYPE> class VertexAttrib<TYPE, 2, false> {
     typedef TYPE type; enum{n_elem=2, normalized=false};
     TYPE elem[2];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(float(a[0]),float(a[1]),0,1);
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = TYPE(val.x); a[1] = TYPE(val.y);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 template<typename TYPE> class VertexAttrib<TYPE, 3, true> {
@@ -76,13 +81,14 @@ template<typename TYPE> class VertexAttrib<TYPE, 3, true> {
     typedef TYPE type; enum{n_elem=3, normalized=true};
     TYPE elem[3];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(normalizeValue<TYPE,float>(a[0]),normalizeValue<TYPE,float>(a[1]),normalizeValue<TYPE,float>(a[2]),1);
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = normalizeValue<float,TYPE>(val.x); a[1] = normalizeValue<float,TYPE>(val.y);
         a[2] = normalizeValue<float,TYPE>(val.z);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 template<typename TYPE> class VertexAttrib<TYPE, 3, false> {
@@ -90,12 +96,13 @@ template<typename TYPE> class VertexAttrib<TYPE, 3, false> {
     typedef TYPE type; enum{n_elem=3, normalized=false};
     TYPE elem[3];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(float(a[0]),float(a[1]),float(a[2]),1);
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = TYPE(val.x); a[1] = TYPE(val.y); a[2] = TYPE(val.z);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 template<typename TYPE> class VertexAttrib<TYPE, 4, true> {
@@ -103,14 +110,15 @@ template<typename TYPE> class VertexAttrib<TYPE, 4, true> {
     typedef TYPE type; enum{n_elem=4, normalized=true};
     TYPE elem[4];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(normalizeValue<TYPE,float>(a[0]),normalizeValue<TYPE,float>(a[1]),normalizeValue<TYPE,float>(a[2]),
                             normalizeValue<TYPE,float>(a[3]));
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = normalizeValue<float,TYPE>(val.x); a[1] = normalizeValue<float,TYPE>(val.y);
         a[2] = normalizeValue<float,TYPE>(val.z); a[3] = normalizeValue<float,TYPE>(val.w);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 template<typename TYPE> class VertexAttrib<TYPE, 4, false> {
@@ -118,12 +126,13 @@ template<typename TYPE> class VertexAttrib<TYPE, 4, false> {
     typedef TYPE type; enum{n_elem=4, normalized=false};
     TYPE elem[4];
     static float4 getAttrib(const void* attrib){
-        const TYPE* a = (const TYPE*)attrib;
+        TYPE a[n_elem]; memcpy(a, attrib, sizeof(a));
         return float4::make(float(a[0]),float(a[1]),float(a[2]),float(a[3]));
     }
     static void setAttrib(void* attrib, float4 val){
-        TYPE* a = (TYPE*)attrib;
+        TYPE a[n_elem];
         a[0] = TYPE(val.x); a[1] = TYPE(val.y); a[2] = TYPE(val.z); a[3] = TYPE(val.w);
+        memcpy(attrib, a, sizeof(a));
     }
 };
 
@@ -176,48 +185,61 @@ class IndexFormat {
 	friend class IndexBuffer;
 	uchar bpi;
 	template<typename TYPE> static uint getIndex(const void* data){
-		TYPE* a = (TYPE*)data; return a[0];
+		TYPE a; memcpy(&a, data, sizeof(a)); return a;
 	}
 	template<typename TYPE> static void setIndex(void* data, uint value){
-		TYPE* a = (TYPE*)data; a[0] = (TYPE)value;
+		TYPE a = (TYPE)value; memcpy(data, &a, sizeof(a));
 	}
 public:
-	IndexFormat(int vertex_count){
+	IndexFormat(longlong vertex_count){
 		if(vertex_count < uchar_max){bpi = 1; get = &getIndex<uchar>; set = &setIndex<uchar>;}
 		else if(vertex_count < ushort_max){bpi = 2; get = &getIndex<ushort>; set = &setIndex<ushort>;}
 		else {bpi = 4; get = &getIndex<uint>; set = &setIndex<uint>;}
 	}
 	IndexGetFunc get; IndexSetFunc set;
+	inline uchar getBytesPerIndex() const {return bpi;}
 };
 
 class VertexBuffer {
-	void* data; const VertexFormat* format; int vertices;
-	inline void* offset(int vertex, int attribute) const {return bufferOffset(data, vertex*format->bpv+format->attributes[attribute].offset);}
+	void* data; const VertexFormat* format; longlong vertices; bool owned;
+	inline void* offset(longlong vertex, int attribute) const {return bufferOffset(data, (ptr_diff_t)vertex*format->bpv+format->attributes[attribute].offset);}
 public:
-	VertexBuffer(const VertexFormat* fmt, int vert) : data(malloc(fmt->bpv*vert)), format(fmt), vertices(vert) {memset(data, 0, fmt->bpv*vert);}
-	~VertexBuffer(){free(data);}
-	inline void set(int vertex, int attribute, const float4& value){
+	/** Creates a vertex buffer with uninitialized contents. Every attribute of every vertex must be set before it is read. */
+	VertexBuffer(const VertexFormat* fmt, longlong vert) : data(malloc(getSize(fmt, vert))), format(fmt), vertices(vert), owned(true) {}
+	/** Creates a vertex buffer over existing storage of at least getSize() bytes, such as a mapped output file.
+	 * The storage is not freed by the vertex buffer. */
+	VertexBuffer(const VertexFormat* fmt, longlong vert, void* storage) : data(storage), format(fmt), vertices(vert), owned(false) {}
+	~VertexBuffer(){if(owned) free(data);}
+	inline void set(longlong vertex, int attribute, const float4& value){
 		format->attributes[attribute].setAttrib(offset(vertex, attribute), value);
 	}
-	inline float4 get(int vertex, int attribute) const {
+	inline float4 get(longlong vertex, int attribute) const {
 		return format->attributes[attribute].getAttrib(offset(vertex, attribute));
 	}
-	inline int getVertexCount() const {return vertices;}
+	inline longlong getVertexCount() const {return vertices;}
 	inline const void* getBytes() const {return data;}
-	inline int getSize() const {return format->bpv*vertices;}
+	inline ulonglong getSize() const {return getSize(format, vertices);}
+	/** Returns the size in bytes of a vertex buffer with the passed format and vertex count. */
+	static inline ulonglong getSize(const VertexFormat* fmt, longlong vert){return (ulonglong)fmt->bpv*vert;}
 };
 
 class IndexBuffer {
-	void* data; const IndexFormat* format; int indices;
-	inline void* offset(int i) const {return bufferOffset(data, i*format->bpi);}
+	void* data; const IndexFormat* format; longlong indices; bool owned;
+	inline void* offset(longlong i) const {return bufferOffset(data, (ptr_diff_t)i*format->bpi);}
 public:
-	IndexBuffer(const IndexFormat* fmt, int count) : data(malloc(fmt->bpi*count)), format(fmt), indices(count) {memset(data, 0, fmt->bpi*count);}
-	~IndexBuffer(){free(data);}
-	inline void set(int i, uint value){format->set(offset(i), value);}
-	inline uint get(int i) const {return format->get(offset(i));}
-	inline int getIndexCount() const {return indices;}
+	/** Creates an index buffer with uninitialized contents. Every index must be set before it is read. */
+	IndexBuffer(const IndexFormat* fmt, longlong count) : data(malloc(getSize(fmt, count))), format(fmt), indices(count), owned(true) {}
+	/** Creates an index buffer over existing storage of at least getSize() bytes, such as a mapped output file.
+	 * The storage is not freed by the index buffer. */
+	IndexBuffer(const IndexFormat* fmt, longlong count, void* storage) : data(storage), format(fmt), indices(count), owned(false) {}
+	~IndexBuffer(){if(owned) free(data);}
+	inline void set(longlong i, uint value){format->set(offset(i), value);}
+	inline uint get(longlong i) const {return format->get(offset(i));}
+	inline longlong getIndexCount() const {return indices;}
 	inline const void* getBytes() const {return data;}
-	inline int getSize() const {return format->bpi*indices;}
+	inline ulonglong getSize() const {return getSize(format, indices);}
+	/** Returns the size in bytes of an index buffer with the passed format and index count. */
+	static inline ulonglong getSize(const IndexFormat* fmt, longlong count){return (ulonglong)fmt->bpi*count;}
 };
 
 #endif // CORE_RENDERER_VERTEXFORMAT_H_INCLUDED
\ No newline at end of file
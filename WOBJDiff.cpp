@@ -0,0 +1,130 @@
+/** @file WOBJDiff.cpp
+ * wobjdiff: compares two WOBJ files part by part and ranks the changes by how many bytes they added or removed,
+ * to find what made a re-export bigger or slower to load.
+ * Usage: wobjdiff old.wobj new.wobj [-channels]
+ */
+
+#include "WOBJTools.h"
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** The most changed channels listed for an animation without -channels. */
+const size_t MAX_CHANNELS = 10;
+
+/** A change in the size of one part of a file. */
+struct SizeChange {
+	std::string name; ulonglong before, after;
+	inline longlong delta() const {return (longlong)after-(longlong)before;}
+};
+/** A channel whose key counts differ between the files, matched by node index. Either channel is NULL if the
+ * animation has no channel for the node in that file. */
+struct ChannelChange {
+	int node; const WOBJChannel* before; const WOBJChannel* after;
+	inline longlong delta() const {return (longlong)(after == NULL?0:getChannelSize(*after))-(longlong)(before == NULL?0:getChannelSize(*before));}
+};
+/** Changes ranked by how many bytes they added or removed, largest first, and in file order when equal. */
+typedef std::multimap<ulonglong, SizeChange, std::greater<ulonglong> > SizeRanking;
+typedef std::multimap<ulonglong, ChannelChange, std::greater<ulonglong> > ChannelRanking;
+
+std::string signedBytes(longlong d){std::ostringstream s; s << (d > 0?"+":"") << d << " bytes"; return s.str();}
+std::string boundsString(const float* b){
+	std::ostringstream s; s << "[" << b[0] << "," << b[1] << "," << b[2] << "] - [" << b[3] << "," << b[4] << "," << b[5] << "]"; return s.str();
+}
+/** Prints a property of both files if it changed. */
+template<class T> void printChange(const char* name, const T& before, const T& after){
+	if(!(before == after)) std::cout << "  " << name << ": " << before << " -> " << after << std::endl;
+}
+int findAnimation(const WOBJFile& file, const std::string& name){
+	for(size_t a=0; a<file.animations.size(); a++) if(file.animations[a].name == name) return (int)a;
+	return -1;
+}
+/** Warns about animation names a file uses more than once, since animations are matched by name and only the first
+ * with a name is compared. */
+void warnDuplicateNames(const char* path, const WOBJFile& file){
+	std::map<std::string, int> count; for(size_t a=0; a<file.animations.size(); a++) count[file.animations[a].name]++;
+	for(std::map<std::string, int>::const_iterator i = count.begin(); i != count.end(); ++i) if(i->second > 1)
+		std::cout << "Warning: " << path << " has " << i->second << " animations named " << i->first << ", only the first is compared" << std::endl;
+}
+int getBoneCount(const WOBJFile& file){int n = 0; for(size_t i=0; i<file.nodes.size(); i++) if(file.nodes[i].bone >= 0) n++; return n;}
+ulonglong getKeyCount(const WOBJAnimation& anim){ulonglong n = 0; for(size_t c=0; c<anim.channels.size(); c++) n += getKeyCount(anim.channels[c]); return n;}
+
+/** Prints the channels of an animation whose key counts differ between the files, largest change in bytes first,
+ * stopping after MAX_CHANNELS unless all is true. */
+void printChannelChanges(const WOBJAnimation& before, const WOBJAnimation& after, bool all){
+	std::map<int, ChannelChange> byNode;
+	for(size_t c=0; c<before.channels.size(); c++){ChannelChange& ch = byNode[before.channels[c].node]; ch.node = before.channels[c].node; ch.before = &before.channels[c]; ch.after = NULL;}
+	for(size_t c=0; c<after.channels.size(); c++){
+		int node = after.channels[c].node; if(byNode.find(node) == byNode.end()){byNode[node].node = node; byNode[node].before = NULL;}
+		byNode[node].after = &after.channels[c];
+	} ChannelRanking changes;
+	for(std::map<int, ChannelChange>::const_iterator i = byNode.begin(); i != byNode.end(); ++i){
+		const ChannelChange& c = i->second;
+		if(c.before == NULL || c.after == NULL || c.before->position.size() != c.after->position.size()
+			|| c.before->rotation.size() != c.after->rotation.size() || c.before->scale.size() != c.after->scale.size()) changes.insert(std::make_pair((ulonglong)llabs(c.delta()), c));
+	} size_t n = 0;
+	for(ChannelRanking::const_iterator i = changes.begin(); i != changes.end() && (all || n < MAX_CHANNELS); ++i, n++){
+		const ChannelChange& c = i->second; std::cout << "    Channel: node " << c.node;
+		if(c.before == NULL) std::cout << " (added)"; else if(c.after == NULL) std::cout << " (removed)";
+		else std::cout << ", Keys: " << c.before->position.size()/4 << " -> " << c.after->position.size()/4 << " position, " << c.before->rotation.size()/5
+			<< " -> " << c.after->rotation.size()/5 << " rotation, " << c.before->scale.size()/4 << " -> " << c.after->scale.size()/4 << " scale";
+		std::cout << ", " << signedBytes(c.delta()) << std::endl;
+	} if(!all && changes.size() > MAX_CHANNELS) std::cout << "    " << changes.size()-MAX_CHANNELS << " more changed channels (see -channels)" << std::endl;
+}
+
+/** Prints what changed from one WOBJ file to another. Returns false if either is not a valid WOBJ file. */
+bool printDiff(const char* beforePath, const char* afterPath, bool channels){
+	std::vector<char> beforeData, afterData; WOBJFile before, after;
+	if(!readWOBJ(beforePath, beforeData, before) || !readWOBJ(afterPath, afterData, after)) return false;
+	longlong delta = (longlong)afterData.size()-(longlong)beforeData.size();
+	std::cout << beforePath << " -> " << afterPath << ": " << beforeData.size() << " -> " << afterData.size() << " bytes (" << signedBytes(delta);
+	if(!beforeData.empty()){
+		std::ostringstream percent; percent << std::fixed << std::setprecision(1) << (delta >= 0?"+":"") << 100.0*delta/beforeData.size() << "%";
+		std::cout << ", " << percent.str();
+	} std::cout << ")" << std::endl;
+
+	if(!before.animations.empty() && !after.animations.empty() && before.nodes.size() != after.nodes.size())
+		std::cout << "Warning: The node tables differ in size, channels are matched by node index and may not be the same nodes" << std::endl;
+	warnDuplicateNames(beforePath, before); warnDuplicateNames(afterPath, after);
+	printChange("Large", std::string(before.large?"yes":"no"), std::string(after.large?"yes":"no"));
+	printChange("Bytes per vertex", before.vertexStride, after.vertexStride); printChange("Bytes per index", before.bytesPerIndex, after.bytesPerIndex);
+	printChange("Vertices", before.vertexCount, after.vertexCount); printChange("Indices", before.indexCount, after.indexCount);
+	printChange("Bounds", boundsString(before.bounds), boundsString(after.bounds));
+	printChange("Nodes", before.nodes.size(), after.nodes.size()); printChange("Bones", getBoneCount(before), getBoneCount(after));
+	printChange("Mesh subsets", before.subsets.size(), after.subsets.size()); printChange("Animations", before.animations.size(), after.animations.size());
+	for(size_t a=0; a<before.animations.size(); a++) if(findAnimation(after, before.animations[a].name) < 0)
+		std::cout << "  Removed animation: " << before.animations[a].name << ", " << getAnimationSize(before.animations[a]) << " bytes" << std::endl;
+	for(size_t a=0; a<after.animations.size(); a++){
+		const WOBJAnimation& anim = after.animations[a]; int b = findAnimation(before, anim.name);
+		if(b < 0){std::cout << "  Added animation: " << anim.name << ", " << getAnimationSize(anim) << " bytes" << std::endl; continue;}
+		const WOBJAnimation& old = before.animations[b]; ulonglong oldKeys = getKeyCount(old), keys = getKeyCount(anim);
+		if(old.duration == anim.duration && old.channels.size() == anim.channels.size() && oldKeys == keys && getAnimationSize(old) == getAnimationSize(anim)) continue;
+		std::cout << "  Animation: " << anim.name << ", Duration: " << old.duration << " -> " << anim.duration << ", Channels: " << old.channels.size() << " -> " << anim.channels.size()
+			<< ", Keys: " << oldKeys << " -> " << keys << ", " << signedBytes((longlong)getAnimationSize(anim)-(longlong)getAnimationSize(old)) << std::endl;
+		printChannelChanges(old, anim, channels);
+	}
+
+	SizeTable beforeSizes, afterSizes; addSizes(before, beforeData.size(), beforeSizes, true); addSizes(after, afterData.size(), afterSizes, true);
+	SizeRanking changes; SizeTable names; beforeSizes.addTo(names); afterSizes.addTo(names);
+	for(size_t i=0; i<names.getNames().size(); i++){
+		const std::string& name = names.getNames()[i]; SizeChange c = {name, beforeSizes.get(name), afterSizes.get(name)};
+		if(c.delta() != 0) changes.insert(std::make_pair((ulonglong)llabs(c.delta()), c));
+	} if(!changes.empty()) std::cout << "Changes by size:" << std::endl;
+	for(SizeRanking::const_iterator i = changes.begin(); i != changes.end(); ++i){
+		const SizeChange& c = i->second;
+		std::cout << "  " << std::left << std::setw(24) << c.name << std::right << std::setw(14) << c.before << " -> " << std::setw(14) << c.after
+			<< std::setw(20) << signedBytes(c.delta()) << std::endl;
+	} return true;
+}
+
+int main(int argc, char *argv[]){
+	std::vector<const char*> files; bool channels = false;
+	for(int i=1; i<argc; i++){if(strcmp(argv[i], "-channels") == 0) channels = true; else files.push_back(argv[i]);}
+	if(files.size() != 2){std::cout << "Usage: wobjdiff old.wobj new.wobj [-channels]" << std::endl; return -1;}
+	return printDiff(files[0], files[1], channels)?0:-1;
+}
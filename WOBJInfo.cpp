@@ -0,0 +1,96 @@
+/** @file WOBJInfo.cpp
+ * wobjinfo: prints where the bytes of WOBJ files go, section by section, and flags data that could be left out.
+ * Usage: wobjinfo file.wobj... [-channels]
+ */
+
+#include "AnimSampler.h"
+#include "WOBJTools.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/** How far a key can be from another and still count as the same value. */
+const float WASTE_EPSILON = 0.0001f;
+bool sameVector(const float* k, const float3& v){return fabs(k[0]-v.x) < WASTE_EPSILON && fabs(k[1]-v.y) < WASTE_EPSILON && fabs(k[2]-v.z) < WASTE_EPSILON;}
+/** Compares a (w, x, y, z) key to a quaternion, treating q and -q as the same rotation. */
+bool sameQuat(const float* k, const float4& q){
+	float d = k[0]*q.w+k[1]*q.x+k[2]*q.y+k[3]*q.z; return fabs(fabs(d)-1) < WASTE_EPSILON;
+}
+/** Returns true if every key of a track has the same value as its first key. */
+bool isConstant(const std::vector<float>& track, int stride){
+	for(size_t i=stride; i<track.size(); i+=stride){
+		bool same = true; for(int j=1; j<stride; j++) same = same && fabs(track[i+j]-track[j]) < WASTE_EPSILON;
+		if(!same && stride == 5) same = sameQuat(&track[i+1], float4::make(track[2], track[3], track[4], track[1]));
+		if(!same) return false;
+	} return true;
+}
+/** Returns true if every key of a vector track equals rest, so the track could have no keys. */
+bool isAtRest(const std::vector<float>& track, const float3& rest){
+	for(size_t i=0; i<track.size(); i+=4) if(!sameVector(&track[i+1], rest)) return false;
+	return true;
+}
+bool isAtRest(const std::vector<float>& track, const float4& rest){
+	for(size_t i=0; i<track.size(); i+=5) if(!sameQuat(&track[i+1], rest)) return false;
+	return true;
+}
+
+/** Prints the size breakdown of a WOBJ file and its waste, adding its categories to totals. Returns false if the
+ * file is not a valid WOBJ file. */
+bool printInfo(const char* path, bool channels, SizeTable& totals){
+	std::vector<char> data; WOBJFile file; if(!readWOBJ(path, data, file)) return false;
+	ulonglong fileSize = data.size(); SizeTable table; bool animated = !file.animations.empty();
+	std::cout << path << ": " << fileSize << " bytes" << (file.large?", large":"") << ", Vertices: " << file.vertexCount << ", Indices: " << file.indexCount
+		<< " (" << file.bytesPerIndex << " bytes each), Animations: " << file.animations.size() << ", Nodes: " << file.nodes.size() << std::endl;
+	addSizes(file, fileSize, table, false);
+
+	std::vector<bool> additive(file.animations.size(), false); const WOBJSection* addv = file.findSection(FOURCC('A','D','D','V'));
+	if(addv != NULL){
+		WOBJInput in(addv->data, addv->size); int n = in.readInt();
+		for(int i=0; i<n && in.good(); i++){int a = in.readInt(); in.readInt(); if(a >= 0 && a < (int)additive.size()) additive[a] = true;}
+	} AnimSampler* sampler = animated?new AnimSampler(file):NULL; int constantTracks = 0, restTracks = 0, restChannels = 0;
+	for(size_t a=0; a<file.animations.size(); a++){
+		const WOBJAnimation& anim = file.animations[a]; ulonglong keys = 0;
+		for(size_t c=0; c<anim.channels.size(); c++) keys += getKeyCount(anim.channels[c]);
+		std::cout << "  Animation: " << anim.name << (additive[a]?" (additive)":"") << ", Duration: " << anim.duration << ", Channels: " << anim.channels.size()
+			<< ", Keys: " << keys << ", " << getAnimationSize(anim) << " bytes" << std::endl;
+		for(size_t c=0; c<anim.channels.size(); c++){
+			const WOBJChannel& ch = anim.channels[c]; ulonglong cbytes = getChannelSize(ch);
+			float3 t = additive[a]?float3::make(0, 0, 0):sampler->getBindTranslation(ch.node), s = additive[a]?float3::make(1, 1, 1):sampler->getBindScale(ch.node);
+			float4 q = additive[a]?float4::make(0, 0, 0, 1):sampler->getBindRotation(ch.node);
+			bool rt = isAtRest(ch.position, t), rr = isAtRest(ch.rotation, q), rs = isAtRest(ch.scale, s);
+			if(rt && rr && rs) restChannels++;
+			const std::vector<float>* tracks[3] = {&ch.position, &ch.rotation, &ch.scale}; bool rest[3] = {rt, rr, rs};
+			for(int k=0; k<3; k++){
+				int stride = k == 1?5:4; if(tracks[k]->empty()) continue;
+				if(rest[k]) restTracks++; else if(tracks[k]->size() > (size_t)stride && isConstant(*tracks[k], stride)) constantTracks++;
+			} if(channels) std::cout << "    Channel: node " << ch.node << ", Keys: " << ch.position.size()/4 << " position, " << ch.rotation.size()/5
+				<< " rotation, " << ch.scale.size()/4 << " scale, " << cbytes << " bytes" << ((rt && rr && rs)?", at bind pose":"") << std::endl;
+		}
+	} table.print(fileSize);
+
+	if(constantTracks > 0) std::cout << "  Waste: " << constantTracks << " constant tracks with more than one key" << std::endl;
+	if(restTracks > 0) std::cout << "  Waste: " << restTracks << " tracks that only hold the bind pose (or no change, for additive animations), which -droprest leaves out" << std::endl;
+	if(restChannels > 0) std::cout << "  Waste: " << restChannels << " channels that only hold the bind pose, which -droprest leaves out" << std::endl;
+	if(animated){
+		std::vector<bool> used(sampler->getBoneCount(), false);
+		for(longlong v=0; v<file.vertexCount; v++){
+			float vert[16]; memcpy(vert, file.getVertex(v), 64);
+			for(int j=0; j<4; j++){int b = getBoneIndex(vert[8+j], (int)used.size()); if(vert[12+j] > 0 && b >= 0) used[b] = true;}
+		} int unused = 0; for(size_t b=0; b<used.size(); b++) if(!used[b]) unused++;
+		if(unused > 0) std::cout << "  Waste: " << unused << " of " << used.size() << " bones are not weighted to any vertex" << std::endl;
+	} std::vector<bool> referenced(file.vertexCount, false); longlong unreferenced = 0;
+	for(longlong i=0; i<file.indexCount; i++){uint v = file.getIndex(i); if(v < referenced.size()) referenced[v] = true;}
+	for(longlong v=0; v<file.vertexCount; v++) if(!referenced[v]) unreferenced++;
+	if(unreferenced > 0) std::cout << "  Waste: " << unreferenced << " vertices are not referenced by any index" << std::endl;
+	delete sampler; table.addTo(totals); return true;
+}
+
+int main(int argc, char *argv[]){
+	std::vector<const char*> files; bool channels = false;
+	for(int i=1; i<argc; i++){if(strcmp(argv[i], "-channels") == 0) channels = true; else files.push_back(argv[i]);}
+	if(files.empty()){std::cout << "Usage: wobjinfo file.wobj... [-channels]" << std::endl; return -1;}
+	SizeTable totals; int failed = 0; for(size_t i=0; i<files.size(); i++) if(!printInfo(files[i], channels, totals)) failed++;
+	if(files.size()-failed > 1){std::cout << "Total: " << totals.total() << " bytes" << std::endl; totals.print(totals.total());}
+	return failed > 0?-1:0;
+}
@@ -0,0 +1,162 @@
+/** @file WOBJReader.h
+ * Reads WOBJ files written by CreateWOBJ back into memory, for tools and runtime code that consume them.
+ */
+
+#ifndef CORE_WOBJREADER_H_INCLUDED
+#define CORE_WOBJREADER_H_INCLUDED
+
+#include "common.h"
+#include "VertexFormat.h"
+
+#include <cfloat>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/** A bounds checked cursor over a buffer holding a WOBJ file. Reading past the end of the buffer fails the cursor
+ * instead of reading out of bounds, and every read after a failure returns zero.
+ */
+class WOBJInput {
+	const uchar* data; ulonglong size, pos; bool ok;
+public:
+	inline WOBJInput(const void* d, ulonglong s) : data((const uchar*)d), size(s), pos(0), ok(true){}
+	/** Skips len bytes, returning a pointer to them, or NULL (failing the cursor) if the buffer is too short. */
+	const void* skip(ulonglong len){
+		if(!ok || len > size-pos){ok = false; return NULL;}
+		const void* p = data+pos; pos += len; return p;
+	}
+	template<class T> T read(){T v; const void* p = skip(sizeof(T)); if(p == NULL) return 0; memcpy(&v, p, sizeof(T)); return v;}
+	inline uchar readByte(){return read<uchar>();}
+	inline short readShort(){return read<short>();}
+	inline int readInt(){return read<int>();}
+	inline longlong readLong(){return read<longlong>();}
+	inline float readFloat(){return read<float>();}
+	std::string readUTF(){ushort len = read<ushort>(); const char* p = (const char*)skip(len); return p == NULL?std::string():std::string(p, len);}
+	/** Reads an array written as its float count followed by the floats, such as an animation track. The count
+	 * must be a multiple of stride. */
+	bool readFloats(std::vector<float>& out, int stride){
+		int n = readInt(); if(!ok || n < 0 || n%stride != 0 || (ulonglong)n > (size-pos)/4){ok = false; return false;}
+		out.resize(n); for(int i=0; i<n; i++) out[i] = readFloat(); return ok;
+	}
+	/** Fails the cursor, for data that was read successfully but is invalid. */
+	inline void fail(){ok = false;}
+	inline bool good() const {return ok;}
+	inline ulonglong tell() const {return pos;}
+	inline ulonglong remaining() const {return size-pos;}
+};
+
+/** An animation track for one node. Position and scale keys are stored as (time, x, y, z) and rotation keys as
+ * (time, w, x, y, z), in the order they were written. Times are in the animation's ticks. */
+struct WOBJChannel {
+	int node; std::vector<float> position, rotation, scale;
+};
+struct WOBJAnimation {
+	std::string name; float duration; std::vector<WOBJChannel> channels;
+};
+/** A node of the node tree. The children of a node are stored consecutively starting at firstChild, and always
+ * come after their parent, so the tree can be evaluated in order. Matrices are stored row major, like aiMatrix4x4. */
+struct WOBJNode {
+	int numChildren, firstChild, bone; float transform[16], inverseBind[16];
+};
+struct WOBJSubset {
+	std::string name; longlong start, end;
+};
+/** Marks the start of the sections appended after the end of a WOBJ file (and after its mesh subsets, if it has
+ * them). Its first two bytes read as a subset count of 65535, which is more subsets than a file can have, so a
+ * reader can always tell whether subsets or sections come next. */
+const int WOBJ_SECTIONS_MAGIC = FOURCC(0xFF, 0xFF, 'S', 'E');
+/** The most mesh subsets a WOBJ file can have. */
+const int WOBJ_MAX_SUBSETS = 0xFFFE;
+/** An optional section appended after the end of a WOBJ file, identified by its FOURCC tag. */
+struct WOBJSection {
+	int tag; const void* data; ulonglong size;
+};
+
+/** The contents of a WOBJ file. Vertex, index and section data point into the buffer the file was read from,
+ * which must stay valid while they are used; everything else is copied.
+ */
+class WOBJFile {
+	bool readSections(WOBJInput& in){
+		while(in.good() && in.remaining() > 0){
+			WOBJSection s; s.tag = in.readInt(); int len = in.readInt(); if(len < 0) in.fail();
+			s.size = len; s.data = in.skip(s.size); if(in.good()) sections.push_back(s);
+		} return in.good();
+	}
+	/** Returns true if the key times of a track are finite and never decrease, which samplers rely on. */
+	static bool isSorted(const std::vector<float>& track, int stride){
+		float prev = -FLT_MAX; for(size_t i=0; i<track.size(); i+=stride){if(!(track[i] >= prev) || track[i] > FLT_MAX) return false; prev = track[i];}
+		return true;
+	}
+	bool readSubsets(WOBJInput& in){
+		int n = (ushort)in.readShort(); if(n > WOBJ_MAX_SUBSETS) return false;
+		subsets.resize(n);
+		for(int i=0; i<n && in.good(); i++){
+			WOBJSubset& m = subsets[i]; m.name = in.readUTF();
+			if(large){m.start = in.readLong(); m.end = in.readLong();} else {m.start = in.readInt(); m.end = in.readInt();}
+			if(m.start < 0 || m.end < m.start || m.end > indexCount) in.fail();
+		} return in.good();
+	}
+public:
+	/** True if the file is the -large variant, with 64-bit counts and subset offsets. */
+	bool large;
+	longlong vertexCount, indexCount; int vertexStride, bytesPerIndex;
+	const void* vertices; const void* indices; float bounds[6];
+	std::vector<WOBJAnimation> animations; std::vector<WOBJNode> nodes;
+	std::vector<WOBJSubset> subsets; std::vector<WOBJSection> sections;
+
+	inline WOBJFile() : large(false), vertexCount(0), indexCount(0), vertexStride(0), bytesPerIndex(0), vertices(NULL), indices(NULL){}
+	/** Reads a WOBJ file from a buffer. Returns false if the buffer is not a complete, valid WOBJ file. Besides
+	 * the layout, indices are checked to be in range and key times to be sorted, so files that are read
+	 * successfully can be rendered and sampled without further checks. */
+	bool read(const void* data, ulonglong length){
+		WOBJInput in(data, length); animations.clear(); nodes.clear(); subsets.clear(); sections.clear();
+		int count = in.readInt(); large = count == -1;
+		if(large){vertexCount = in.readLong(); indexCount = in.readLong();} else {vertexCount = count; indexCount = in.readInt();}
+		int nAnim = in.readShort(); if(!in.good() || vertexCount < 0 || indexCount < 0 || nAnim < 0 || vertexCount > (longlong)uint_max+1) return false;
+		vertexStride = nAnim > 0?64:32; bytesPerIndex = IndexFormat(vertexCount).getBytesPerIndex();
+		if((ulonglong)vertexCount > in.remaining()/vertexStride) return false;
+		vertices = in.skip(vertexCount*vertexStride);
+		if((ulonglong)indexCount > in.remaining()/bytesPerIndex) return false;
+		indices = in.skip(indexCount*bytesPerIndex); for(longlong i=0; i<indexCount; i++) if(getIndex(i) >= (ulonglong)vertexCount) return false;
+		for(int i=0; i<6; i++) bounds[i] = in.readFloat();
+		animations.resize(nAnim); for(int a=0; a<nAnim && in.good(); a++){
+			WOBJAnimation& anim = animations[a]; anim.name = in.readUTF(); anim.duration = in.readFloat();
+			int nChannels = in.readInt(); if(nChannels < 0 || (ulonglong)nChannels > in.remaining()/14) return false;
+			anim.channels.resize(nChannels); for(int c=0; c<nChannels && in.good(); c++){
+				WOBJChannel& ch = anim.channels[c]; ch.node = in.readShort();
+				in.readFloats(ch.position, 4); in.readFloats(ch.rotation, 5); in.readFloats(ch.scale, 4);
+				if(!isSorted(ch.position, 4) || !isSorted(ch.rotation, 5) || !isSorted(ch.scale, 4)) in.fail();
+			}
+		} if(nAnim > 0){
+			int n = (ushort)in.readShort(); nodes.resize(n);
+			for(int i=0; i<n && in.good(); i++){
+				WOBJNode& node = nodes[i]; node.numChildren = in.readByte(); node.firstChild = node.numChildren > 0?(ushort)in.readShort():0;
+				for(int j=0; j<16; j++) node.transform[j] = in.readFloat();
+				node.bone = in.readShort(); for(int j=0; j<16; j++) node.inverseBind[j] = (j%5 == 0)?1.0f:0.0f;
+				if(node.bone >= 0) for(int j=0; j<16; j++) node.inverseBind[j] = in.readFloat();
+				if(node.numChildren > 0 && (node.firstChild <= i || node.firstChild+node.numChildren > n)) return false;
+			} for(size_t a=0; a<animations.size(); a++) for(size_t c=0; c<animations[a].channels.size(); c++)
+				if(animations[a].channels[c].node < 0 || animations[a].channels[c].node >= n) return false;
+		} if(!in.good()) return false;
+		WOBJInput next = in; if(in.remaining() > 0 && next.readInt() != WOBJ_SECTIONS_MAGIC && !readSubsets(in)) return false;
+		if(in.remaining() == 0) return true;
+		return in.readInt() == WOBJ_SECTIONS_MAGIC && readSections(in);
+	}
+	/** Returns the first section with the passed tag, or NULL if the file has none. */
+	const WOBJSection* findSection(int tag) const {
+		for(size_t i=0; i<sections.size(); i++) if(sections[i].tag == tag) return &sections[i];
+		return NULL;
+	}
+	/** Returns the index at position i of the index buffer. */
+	inline uint getIndex(longlong i) const {
+		const uchar* p = (const uchar*)indices+i*bytesPerIndex;
+		if(bytesPerIndex == 1) return p[0];
+		if(bytesPerIndex == 2){ushort v; memcpy(&v, p, 2); return v;}
+		uint v; memcpy(&v, p, 4); return v;
+	}
+	/** Returns a pointer to the floats of a vertex: position, normal, texture coordinate and (if the file has
+	 * animations) bone indices and bone weights. Vertex data is not aligned, so the floats must be copied out. */
+	inline const void* getVertex(longlong v) const {return (const uchar*)vertices+v*vertexStride;}
+};
+
+#endif // CORE_WOBJREADER_H_INCLUDED
@@ -0,0 +1,84 @@
+/** @file WOBJTools.h
+ * Helpers shared by the wobjinfo and wobjdiff tools: reading whole files, and sizing each part of a WOBJ file
+ * from the layout CreateWOBJ writes.
+ */
+
+#ifndef CORE_WOBJTOOLS_H_INCLUDED
+#define CORE_WOBJTOOLS_H_INCLUDED
+
+#include "WOBJReader.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Reads a whole file into memory. Returns false if it could not be read. */
+inline bool readFile(const char* path, std::vector<char>& data){
+	FILE* f = fopen(path, "rb"); if(f == NULL) return false;
+	char buffer[1 << 16]; size_t n; data.clear();
+	while((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer+n);
+	bool ok = ferror(f) == 0; fclose(f); return ok;
+}
+/** Reads a WOBJ file into data and file, printing an error if it could not be read or is not a valid WOBJ file. */
+inline bool readWOBJ(const char* path, std::vector<char>& data, WOBJFile& file){
+	if(!readFile(path, data)){std::cout << "Error: Could not read " << path << std::endl; return false;}
+	if(data.empty() || !file.read(&data[0], data.size())){std::cout << "Error: " << path << " is not a valid WOBJ file" << std::endl; return false;}
+	return true;
+}
+inline std::string tagName(int tag){
+	std::string s; for(int i=0; i<4; i++){char c = (char)((tag >> (i*8)) & 0xFF); s += (c >= 32 && c < 127)?c:'?';} return s;
+}
+
+/** Byte counts by category, kept in the order categories were first added so reports list them in file order. */
+class SizeTable {
+	std::vector<std::string> names; std::map<std::string, ulonglong> sizes;
+public:
+	void add(const std::string& name, ulonglong size){if(sizes.find(name) == sizes.end()) names.push_back(name); sizes[name] += size;}
+	void addTo(SizeTable& t) const {for(size_t i=0; i<names.size(); i++) t.add(names[i], sizes.find(names[i])->second);}
+	ulonglong total() const {ulonglong t = 0; for(size_t i=0; i<names.size(); i++) t += sizes.find(names[i])->second; return t;}
+	/** Returns the bytes of a category, or 0 if it has none. */
+	ulonglong get(const std::string& name) const {std::map<std::string, ulonglong>::const_iterator i = sizes.find(name); return i == sizes.end()?0:i->second;}
+	inline const std::vector<std::string>& getNames() const {return names;}
+	void print(ulonglong fileSize) const {
+		std::ios::fmtflags flags = std::cout.flags(); std::streamsize precision = std::cout.precision();
+		for(size_t i=0; i<names.size(); i++){
+			ulonglong s = sizes.find(names[i])->second;
+			std::cout << "  " << std::left << std::setw(24) << names[i] << std::right << std::setw(14) << s << " bytes "
+				<< std::fixed << std::setprecision(1) << std::setw(5) << (fileSize > 0?100.0*s/fileSize:0) << "%" << std::endl;
+		} std::cout.flags(flags); std::cout.precision(precision);
+	}
+};
+
+/** Returns the bytes a channel takes: its node (short), and the float count (int) and floats of each track. */
+inline ulonglong getChannelSize(const WOBJChannel& ch){return 14+(ch.position.size()+ch.rotation.size()+ch.scale.size())*4;}
+/** Returns the bytes an animation takes: its name, duration, channel count and channels. */
+inline ulonglong getAnimationSize(const WOBJAnimation& anim){
+	ulonglong bytes = 2+anim.name.size()+8; for(size_t c=0; c<anim.channels.size(); c++) bytes += getChannelSize(anim.channels[c]);
+	return bytes;
+}
+inline ulonglong getKeyCount(const WOBJChannel& ch){return ch.position.size()/4+ch.rotation.size()/5+ch.scale.size()/4;}
+/** Adds the bytes of each part of a WOBJ file of fileSize bytes to table, in file order, with anything that
+ * could not be attributed to a part as "Unaccounted". Animations are added as one category, or each as its own
+ * ("Animation name") if perAnimation is true. */
+inline void addSizes(const WOBJFile& file, ulonglong fileSize, SizeTable& table, bool perAnimation){
+	bool animated = !file.animations.empty(); ulonglong start = table.total();
+	table.add("Header", file.large?22:10);
+	table.add("Vertex positions", file.vertexCount*12); table.add("Vertex normals", file.vertexCount*12); table.add("Vertex UVs", file.vertexCount*8);
+	if(animated){table.add("Vertex bone indices", file.vertexCount*16); table.add("Vertex bone weights", file.vertexCount*16);}
+	table.add("Indices", file.indexCount*file.bytesPerIndex); table.add("Bounds", 24);
+	for(size_t a=0; a<file.animations.size(); a++) table.add(perAnimation?"Animation " + file.animations[a].name:"Animations", getAnimationSize(file.animations[a]));
+	if(animated){
+		ulonglong bytes = 2; for(size_t i=0; i<file.nodes.size(); i++) bytes += 67+(file.nodes[i].numChildren > 0?2:0)+(file.nodes[i].bone >= 0?64:0);
+		table.add("Node table", bytes);
+	} if(!file.subsets.empty()){
+		ulonglong bytes = 2; for(size_t i=0; i<file.subsets.size(); i++) bytes += 2+file.subsets[i].name.size()+(file.large?16:8);
+		table.add("Mesh subsets", bytes);
+	} if(!file.sections.empty()) table.add("Section magic", 4);
+	for(size_t i=0; i<file.sections.size(); i++) table.add("Section " + tagName(file.sections[i].tag), 8+file.sections[i].size);
+	ulonglong counted = table.total()-start; if(counted != fileSize) table.add("Unaccounted", fileSize-counted);
+}
+
+#endif // CORE_WOBJTOOLS_H_INCLUDED
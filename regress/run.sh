@@ -0,0 +1,36 @@
+#!/bin/bash
+# Regression check for CreateWOBJ: converts every case in cases.txt with -checksum, and fails if the log of any case
+# is missing a line checks.txt expects for it, or if the checksum and size of its output differ from goldens.txt.
+# Each case's log is kept in out/. The cases are then converted again with -timesteps, which imports through the
+# step by step post-processing path, and the stage and post-processing step timings are collected in out/timings.txt.
+# Usage: run.sh path/to/CreateWOBJ [-update]
+# -update rewrites goldens.txt from the current outputs instead, for use after a change that is meant to change them.
+if [ -z "$1" ]; then echo "Usage: run.sh path/to/CreateWOBJ [-update]"; exit 1; fi
+exe=$(cd "$(dirname "$1")" && pwd)/$(basename "$1"); update=$2
+cd "$(dirname "$0")" || exit 1
+mkdir -p out; : > out/timings.txt; failed=0; goldens=""
+cases=$(tr -d '\r' < cases.txt | grep -v '^ *\(#\|$\)')
+while read -r name input options; do
+	log=out/$name.log
+	if ! "$exe" "$input" "out/$name.wobj" $options -checksum > "$log" 2>&1; then echo "FAIL $name: conversion failed, see $log"; failed=1; continue; fi
+	tr -d '\r' < "$log" > out/$name.txt && mv out/$name.txt "$log"
+	missing=0; while read -r check; do
+		if ! awk -v t="$check" 'index($0, t) == 1 {found = 1} END {exit !found}' "$log"; then echo "FAIL $name: no line starting with \"$check\", see $log"; missing=1; fi
+	done < <(tr -d '\r' < checks.txt | awk -v n="$name" '$1 == n {sub(/^[^ ]+ +/, ""); print}')
+	if [ $missing = 1 ]; then failed=1; continue; fi
+	result=$(sed -n 's/^Checksum: \([0-9a-f]*\), Size: \([0-9]*\)$/\1 \2/p' "$log")
+	if [ -z "$result" ]; then echo "FAIL $name: no checksum printed, see $log"; failed=1; continue; fi
+	if [ "$update" = -update ]; then goldens+="$name $result"$'\n'; echo "Recorded $name: $result"; continue; fi
+	expected=$(tr -d '\r' < goldens.txt | awk -v n="$name" '$1 == n {print $2, $3}')
+	if [ -z "$expected" ]; then echo "OK $name: checks passed, no golden checksum recorded yet ($result)"
+	elif [ "$expected" != "$result" ]; then echo "FAIL $name: checksum and size $result, expected $expected"; failed=1
+	else echo "OK $name"; fi
+done <<< "$cases"
+if [ "$update" = -update ] && [ $failed = 0 ]; then {
+	grep '^#' goldens.txt; printf %s "$goldens"
+} > out/goldens.txt && mv out/goldens.txt goldens.txt; fi
+while read -r name input options; do
+	if ! "$exe" "$input" "out/$name.timed.wobj" $options -timesteps > "out/$name.timed.log" 2>&1; then echo "FAIL $name: timed conversion failed, see out/$name.timed.log"; failed=1; continue; fi
+	tr -d '\r' < "out/$name.timed.log" | sed -n "s/^\(Read\|Stage\|Step\|Post-processing\): */$name \1 /p" >> out/timings.txt
+done <<< "$cases"
+echo "Timings: $(pwd)/out/timings.txt"; exit $failed